@@ -0,0 +1,297 @@
+/**
+ * Example illustrating fan-in of many pipes with epoll
+ * The parent spawns N producer children, each writing to its own pipe. The
+ * parent sets the read ends non-blocking and waits on all of them at once
+ * with epoll, so a slow child never blocks the others (a blocking `read` on
+ * its pipe would). Lines are merged whole into stdout: a child that writes
+ * half a line is kept in a buffer until the rest arrives.
+ *
+ * At the end, the bytes and lines read from each child are reported in
+ * stderr, along with its stall time: the total time with no data from it for
+ * longer than `STALL_MS`, and the longest of those gaps.
+ *
+ * By default, the children write numbered lines, sometimes in two parts. With
+ * `-- cmd args...`, each child runs the command instead, with its index in
+ * the environment variable `CHILD_ID`.
+ */
+#define _GNU_SOURCE // pipe2
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define READ_END 0
+#define WRITE_END 1
+
+#define LINE_BUF 65536 // longer lines are split
+#define STALL_MS 10    // shorter gaps do not count as stalls
+#define MAX_EVENTS 64
+
+/** The pipe of a child and what was read from it */
+struct child {
+    pid_t pid;
+    int fd;              // -1 after end of file
+    char buf[LINE_BUF];  // the last line, while incomplete
+    size_t len;
+    size_t bytes, lines;
+    double last_data;    // time of the last read with data
+    double stall, max_gap;
+};
+
+/**
+ * @brief Current time of the monotonic clock, in seconds
+ */
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Sleeps for `ms` milliseconds
+ */
+void sleep_ms(long ms) {
+    nanosleep(&(struct timespec){ms / 1000, ms % 1000 * 1000000}, NULL);
+}
+
+/**
+ * @brief Writes the whole buffer. Exits on failure
+ */
+void write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t bytes = write(fd, buf, len);
+        if (bytes == -1) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Failed to write. Cause: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        buf += bytes;
+        len -= bytes;
+    }
+}
+
+/**
+ * @brief Body of a built-in producer: writes `lines` lines, some of them in
+ * two parts, with a pause of `delay_ms` between lines
+ */
+void produce(int id, int lines, long delay_ms) {
+    srand(getpid());
+    for (int i = 0; i < lines; i++) {
+        char line[128];
+        int len = snprintf(line, sizeof(line),
+                           "child %3d line %6d: the quick brown fox\n", id, i);
+        if (rand() % 4 == 0) { // half now, the rest later
+            write_all(STDOUT_FILENO, line, len / 2);
+            sleep_ms(1);
+            write_all(STDOUT_FILENO, line + len / 2, len - len / 2);
+        } else {
+            write_all(STDOUT_FILENO, line, len);
+        }
+        if (delay_ms > 0)
+            sleep_ms(delay_ms);
+    }
+}
+
+/**
+ * @brief Writes the complete lines in the buffer of a child to stdout, in a
+ * single write, and keeps the incomplete one. At end of file, or if the
+ * buffer is full, writes everything
+ *
+ * @param c The child
+ * @param all Whether to write the incomplete line as well
+ */
+void flush_lines(struct child *c, int all) {
+    size_t end = c->len;
+    if (!all && c->len < LINE_BUF) {
+        while (end > 0 && c->buf[end - 1] != '\n')
+            end--;
+    }
+    if (end == 0)
+        return;
+    for (size_t i = 0; i < end; i++)
+        c->lines += c->buf[i] == '\n';
+    write_all(STDOUT_FILENO, c->buf, end);
+    if (all && c->buf[end - 1] != '\n') { // unterminated last line
+        write_all(STDOUT_FILENO, "\n", 1);
+        c->lines++;
+    }
+    memmove(c->buf, c->buf + end, c->len - end);
+    c->len -= end;
+}
+
+/**
+ * @brief Reads everything available from a child, until the pipe is empty
+ * (required with edge-triggered epoll)
+ *
+ * @param epfd The epoll instance, the pipe is removed from it at end of file
+ * @param c The child
+ * @return 1 if the child is still open, 0 at end of file
+ */
+int drain(int epfd, struct child *c) {
+    for (;;) {
+        ssize_t bytes = read(c->fd, c->buf + c->len, LINE_BUF - c->len);
+        if (bytes > 0) {
+            double t = now(), gap = t - c->last_data;
+            if (gap > STALL_MS / 1e3)
+                c->stall += gap;
+            if (gap > c->max_gap)
+                c->max_gap = gap;
+            c->last_data = t;
+            c->len += bytes;
+            c->bytes += bytes;
+            flush_lines(c, 0);
+        } else if (bytes == 0 || errno != EINTR) {
+            if (bytes == -1 && errno == EAGAIN)
+                return 1;
+            if (bytes == -1)
+                fprintf(stderr, "Failed to read from child %d. Cause: %s\n",
+                        c->pid, strerror(errno));
+            flush_lines(c, 1);
+            // 'close' alone would not remove it if a copy of it is open
+            epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+            close(c->fd);
+            c->fd = -1;
+            return 0;
+        }
+    }
+}
+
+void usage(char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-n children] [-l lines] [-d delay_ms] [-s slow_ms] "
+            "[-- cmd args...]\n"
+            "  -n  number of children (default 64)\n"
+            "  -l  lines written by each child (default 1000)\n"
+            "  -d  pause between lines (default 0)\n"
+            "  -s  pause between lines of child 0 (default 2)\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    /* ------ parse arguments ------ */
+    int nchildren = 64, lines = 1000;
+    long delay_ms = 0, slow_ms = 2;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:d:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                nchildren = atoi(optarg);
+                break;
+            case 'l':
+                lines = atoi(optarg);
+                break;
+            case 'd':
+                delay_ms = atol(optarg);
+                break;
+            case 's':
+                slow_ms = atol(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (nchildren <= 0 || lines < 0 || delay_ms < 0 || slow_ms < 0)
+        usage(argv[0]);
+    char **cmd = optind < argc ? &argv[optind] : NULL;
+
+    struct child *children = calloc(nchildren, sizeof(*children));
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (children == NULL || epfd == -1) {
+        fprintf(stderr, "Failed to setup. Cause: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* ------ spawn the children, each with its own pipe ------ */
+    double start = now();
+    for (int i = 0; i < nchildren; i++) {
+        int pipe_fds[2];
+        // close-on-exec, so that children do not hold each other's pipes
+        if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
+            fprintf(stderr, "Failed to create pipe. Cause: %s\n",
+                    strerror(errno));
+            return EXIT_FAILURE;
+        }
+        pid_t pid = fork();
+        if (pid == -1) {
+            fprintf(stderr, "Failed to create process. Cause: %s\n",
+                    strerror(errno));
+            return EXIT_FAILURE;
+        } else if (pid == 0) { // child
+            dup2(pipe_fds[WRITE_END], STDOUT_FILENO);
+            // the built-in producer does not exec, close-on-exec is not enough
+            for (int j = 0; j < i; j++)
+                close(children[j].fd);
+            close(epfd);
+            close(pipe_fds[READ_END]);
+            close(pipe_fds[WRITE_END]);
+            if (cmd != NULL) {
+                char id[16];
+                snprintf(id, sizeof(id), "%d", i);
+                setenv("CHILD_ID", id, 1);
+                execvp(cmd[0], cmd);
+                perror("execvp");
+                _exit(EXIT_FAILURE);
+            }
+            produce(i, lines, i == 0 ? slow_ms : delay_ms);
+            _exit(EXIT_SUCCESS);
+        }
+
+        // parent: only the read end, non-blocking
+        close(pipe_fds[WRITE_END]);
+        fcntl(pipe_fds[READ_END], F_SETFL, O_NONBLOCK);
+        children[i].pid = pid;
+        children[i].fd = pipe_fds[READ_END];
+        children[i].last_data = start;
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLET, .data.u32 = i};
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, children[i].fd, &ev) == -1) {
+            fprintf(stderr, "Failed to add pipe to epoll. Cause: %s\n",
+                    strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* ------ merge the outputs as they come ------ */
+    int open_pipes = nchildren;
+    struct epoll_event events[MAX_EVENTS];
+    while (open_pipes > 0) {
+        int nevents = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (nevents == -1) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Failed to wait. Cause: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        for (int i = 0; i < nevents; i++)
+            if (!drain(epfd, &children[events[i].data.u32]))
+                open_pipes--;
+    }
+    double elapsed = now() - start;
+
+    /* ------ wait for the children and report ------ */
+    fprintf(stderr, "%6s %8s %10s %8s %10s %10s %6s\n", "child", "pid",
+            "bytes", "lines", "stall_ms", "maxgap_ms", "status");
+    size_t total = 0;
+    for (int i = 0; i < nchildren; i++) {
+        struct child *c = &children[i];
+        int status;
+        waitpid(c->pid, &status, 0);
+        fprintf(stderr, "%6d %8d %10zu %8zu %10.1f %10.1f %6d\n", i, c->pid,
+                c->bytes, c->lines, c->stall * 1e3, c->max_gap * 1e3,
+                WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status));
+        total += c->bytes;
+    }
+    fprintf(stderr, "%zu bytes from %d children in %.3f s\n", total,
+            nchildren, elapsed);
+    close(epfd);
+    free(children);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,320 @@
+#define _GNU_SOURCE // pipe2, splice
+
+#include "instrument.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PIPE_READ 0
+#define PIPE_WRITE 1
+
+/** Bytes moved per `splice` */
+#define RELAY_CHUNK (1 << 16)
+
+enum edge_state {
+    EDGE_EMPTY, // waiting for the upstream stage to write
+    EDGE_FULL,  // waiting for the downstream stage to read
+    EDGE_DONE,
+};
+
+/** The pipe between stage `i` and stage `i + 1`, cut in two */
+struct edge {
+    int up[2];   // stage i writes, the relay reads
+    int down[2]; // the relay writes, stage i + 1 reads
+    int state;
+    double since;        // when the current state started
+    double start, end;   // lifetime of the edge
+    double empty, full;  // time spent in each state
+    size_t bytes;
+};
+
+/** A stage and its resource usage */
+struct stage {
+    char *cmd;
+    pid_t pid;
+    int status;
+    double start, end;
+    struct rusage usage;
+};
+
+/**
+ * @brief Current time of the monotonic clock, in seconds
+ */
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * @brief Changes the state of an edge, accounting the time spent in the
+ * previous one
+ */
+static void set_state(struct edge *e, int state, double t) {
+    if (e->state == EDGE_EMPTY)
+        e->empty += t - e->since;
+    else if (e->state == EDGE_FULL)
+        e->full += t - e->since;
+    e->state = state;
+    e->since = t;
+    if (state == EDGE_DONE) {
+        e->end = t;
+        close(e->up[PIPE_READ]);
+        close(e->down[PIPE_WRITE]);
+    }
+}
+
+/**
+ * @brief Moves everything that can be moved through an edge without
+ * blocking, and finds out which side it is now waiting for
+ */
+static void relay(struct edge *e) {
+    for (;;) {
+        ssize_t bytes = splice(e->up[PIPE_READ], NULL, e->down[PIPE_WRITE],
+                               NULL, RELAY_CHUNK,
+                               SPLICE_F_NONBLOCK | SPLICE_F_MOVE);
+        if (bytes > 0) {
+            e->bytes += bytes;
+            continue;
+        }
+        if (bytes == -1 && errno == EINTR)
+            continue;
+        if (bytes == -1 && errno == EAGAIN) {
+            // either side may be the cause, data left upstream means full
+            int avail = 0;
+            ioctl(e->up[PIPE_READ], FIONREAD, &avail);
+            set_state(e, avail > 0 ? EDGE_FULL : EDGE_EMPTY, now());
+            return;
+        }
+        // end of stream upstream, or the downstream stage exited (EPIPE)
+        if (bytes == -1 && errno != EPIPE)
+            fprintf(stderr, "Failed to relay: %s\n", strerror(errno));
+        set_state(e, EDGE_DONE, now());
+        return;
+    }
+}
+
+/**
+ * @brief Reaps the stages that exited, recording their resource usage
+ *
+ * @param flags `WNOHANG` to return when none is left to reap, 0 to block
+ * @return The number of stages reaped
+ */
+static int reap(struct stage *stages, int nstages, int flags) {
+    int reaped = 0;
+    for (;;) {
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, flags, &usage);
+        if (pid <= 0)
+            return reaped;
+        for (int i = 0; i < nstages; i++) {
+            if (stages[i].pid == pid) {
+                stages[i].end = now();
+                stages[i].usage = usage;
+                stages[i].status = WIFEXITED(status) ? WEXITSTATUS(status)
+                                                     : 128 + WTERMSIG(status);
+                reaped++;
+            }
+        }
+        if (flags == 0 && reaped == 1)
+            return reaped;
+    }
+}
+
+/**
+ * @brief Writes a string as a JSON string literal
+ */
+static void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(f, "\\u%04x", *s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void report_human(const struct stage *stages, int nstages,
+                         const struct edge *edges, double elapsed) {
+    fprintf(stderr, "%5s %-30s %6s %8s %8s %8s\n", "stage", "command",
+            "status", "user_s", "sys_s", "wall_s");
+    for (int i = 0; i < nstages; i++) {
+        const struct stage *s = &stages[i];
+        fprintf(stderr, "%5d %-30.30s %6d %8.3f %8.3f %8.3f\n", i, s->cmd,
+                s->status, seconds(s->usage.ru_utime),
+                seconds(s->usage.ru_stime), s->end - s->start);
+    }
+    fprintf(stderr, "%5s %14s %10s %6s %6s\n", "edge", "bytes", "MB/s",
+            "full%", "empty%");
+    for (int i = 0; i < nstages - 1; i++) {
+        const struct edge *e = &edges[i];
+        double life = e->end - e->start;
+        fprintf(stderr, "%2d->%-2d %14zu %10.1f %6.1f %6.1f\n", i, i + 1,
+                e->bytes, life > 0 ? e->bytes / life / 1e6 : 0,
+                life > 0 ? 100 * e->full / life : 0,
+                life > 0 ? 100 * e->empty / life : 0);
+    }
+    fprintf(stderr, "elapsed %.3f s\n", elapsed);
+}
+
+static int report_json(const char *path, const struct stage *stages,
+                       int nstages, const struct edge *edges, double elapsed) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        return -1;
+    fprintf(f, "{\n  \"elapsed_s\": %.6f,\n  \"stages\": [", elapsed);
+    for (int i = 0; i < nstages; i++) {
+        const struct stage *s = &stages[i];
+        fprintf(f, "%s\n    {\"index\": %d, \"cmd\": ", i > 0 ? "," : "", i);
+        json_string(f, s->cmd);
+        fprintf(f,
+                ", \"pid\": %d, \"status\": %d, \"user_s\": %.6f, "
+                "\"sys_s\": %.6f, \"wall_s\": %.6f}",
+                s->pid, s->status, seconds(s->usage.ru_utime),
+                seconds(s->usage.ru_stime), s->end - s->start);
+    }
+    fprintf(f, "\n  ],\n  \"edges\": [");
+    for (int i = 0; i < nstages - 1; i++) {
+        const struct edge *e = &edges[i];
+        double life = e->end - e->start;
+        fprintf(f,
+                "%s\n    {\"from\": %d, \"to\": %d, \"bytes\": %zu, "
+                "\"bytes_per_s\": %.1f, \"full\": %.4f, \"empty\": %.4f}",
+                i > 0 ? "," : "", i, i + 1, e->bytes,
+                life > 0 ? e->bytes / life : 0, life > 0 ? e->full / life : 0,
+                life > 0 ? e->empty / life : 0);
+    }
+    fprintf(f, "\n  ]\n}\n");
+    return fclose(f);
+}
+
+int run_instrumented(char **cmds, int nstages, int (*run_stage)(char *),
+                     int human, const char *json_path) {
+    struct stage *stages = calloc(nstages, sizeof(*stages));
+    struct edge *edges = calloc(nstages, sizeof(*edges));
+    struct pollfd *fds = malloc(nstages * sizeof(*fds));
+    struct edge **polled = malloc(nstages * sizeof(*polled));
+    if (stages == NULL || edges == NULL || fds == NULL || polled == NULL) {
+        fprintf(stderr, "Failed to allocate memory for the pipeline\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* ------ create the edges ------ */
+    double start = now();
+    for (int i = 0; i < nstages - 1; i++) {
+        struct edge *e = &edges[i];
+        if (pipe2(e->up, O_CLOEXEC) == -1 || pipe2(e->down, O_CLOEXEC) == -1) {
+            fprintf(stderr, "Failed to create pipe: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        // only the relay's ends, the stages see ordinary blocking pipes
+        fcntl(e->up[PIPE_READ], F_SETFL, O_NONBLOCK);
+        fcntl(e->down[PIPE_WRITE], F_SETFL, O_NONBLOCK);
+        e->state = EDGE_EMPTY;
+        e->start = e->since = start;
+    }
+
+    /* ------ start the stages ------ */
+    for (int i = 0; i < nstages; i++) {
+        // the command is parsed in place by 'run_stage', keep a copy
+        const char *cmd = cmds[i] + strspn(cmds[i], " ");
+        size_t len = strlen(cmd);
+        while (len > 0 && cmd[len - 1] == ' ')
+            len--;
+        stages[i].cmd = strndup(cmd, len);
+        stages[i].start = now();
+        if ((stages[i].pid = fork()) == -1) {
+            fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        } else if (stages[i].pid == 0) {
+            if (i > 0)
+                dup2(edges[i - 1].down[PIPE_READ], STDIN_FILENO);
+            if (i < nstages - 1)
+                dup2(edges[i].up[PIPE_WRITE], STDOUT_FILENO);
+            // close-on-exec is not enough, a stage may not exec (replicas)
+            for (int j = 0; j < nstages - 1; j++) {
+                close(edges[j].up[PIPE_READ]);
+                close(edges[j].up[PIPE_WRITE]);
+                close(edges[j].down[PIPE_READ]);
+                close(edges[j].down[PIPE_WRITE]);
+            }
+            run_stage(cmds[i]);
+            _exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < nstages - 1; i++) {
+        close(edges[i].up[PIPE_WRITE]);
+        close(edges[i].down[PIPE_READ]);
+    }
+
+    /* ------ relay the edges until all are closed ------ */
+    // a stage that exits early must not kill the launcher
+    signal(SIGPIPE, SIG_IGN);
+    int reaped = 0;
+    for (;;) {
+        int nfds = 0;
+        for (int i = 0; i < nstages - 1; i++) {
+            struct edge *e = &edges[i];
+            if (e->state == EDGE_EMPTY)
+                fds[nfds] = (struct pollfd){e->up[PIPE_READ], POLLIN, 0};
+            else if (e->state == EDGE_FULL)
+                fds[nfds] = (struct pollfd){e->down[PIPE_WRITE], POLLOUT, 0};
+            else
+                continue;
+            polled[nfds++] = e;
+        }
+        if (nfds == 0)
+            break;
+        if (poll(fds, nfds, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Failed to poll: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < nfds; i++)
+            if (fds[i].revents != 0)
+                relay(polled[i]);
+        // early, so that their wall time is accurate
+        reaped += reap(stages, nstages, WNOHANG);
+    }
+
+    /* ------ wait for the stages and report ------ */
+    while (reaped < nstages && reap(stages, nstages, 0) == 1)
+        reaped++;
+    double elapsed = now() - start;
+
+    if (human)
+        report_human(stages, nstages, edges, elapsed);
+    if (json_path != NULL &&
+        report_json(json_path, stages, nstages, edges, elapsed) != 0)
+        fprintf(stderr, "Failed to write '%s': %s\n", json_path,
+                strerror(errno));
+
+    int status = stages[nstages - 1].status;
+    for (int i = 0; i < nstages; i++)
+        free(stages[i].cmd);
+    free(stages);
+    free(edges);
+    free(fds);
+    free(polled);
+    return status;
+}
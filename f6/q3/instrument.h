@@ -0,0 +1,34 @@
+/**
+ * Instrumented pipelines for `sol.c`.
+ *
+ * Instead of connecting the stages directly, each pipe is cut in two and the
+ * launcher relays the data between the halves with `splice`, which moves
+ * pages between pipes without copying them. While relaying, it knows which
+ * side of each edge holds the data back:
+ *  - full: data is waiting but the downstream pipe is full, the downstream
+ *    stage is slower;
+ *  - empty: the upstream pipe is empty (`FIONREAD`), the upstream stage is
+ *    slower.
+ *
+ * At the end, it reports the bytes and bytes/s of each edge, the fraction of
+ * its time it was full or empty, and the CPU and wall time of each stage, in
+ * human-readable form and/or as JSON.
+ */
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+/**
+ * @brief Runs the stages of a pipeline as children of the caller, relays and
+ * measures the data between them, and reports the statistics
+ *
+ * @param stages The command of each stage
+ * @param nstages The number of stages
+ * @param run_stage Runs a stage in the child process, does not return
+ * @param human Whether to print a report to stderr
+ * @param json_path Where to write the report as JSON, or `NULL`
+ * @return The exit status of the last stage
+ */
+int run_instrumented(char **stages, int nstages, int (*run_stage)(char *),
+                     int human, const char *json_path);
+
+#endif
@@ -0,0 +1,285 @@
+#define _GNU_SOURCE // pipe2
+
+#include "replica.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PIPE_READ 0
+#define PIPE_WRITE 1
+
+/** A block of the input and the replica processing it */
+struct job {
+    int busy;        // the slot is in use, until the output is written
+    size_t seq;      // position of the block in the input
+    pid_t pid;
+    int status;      // exit code of the replica, or 128 + the signal
+    int in, out;     // pipes to the stdin and from the stdout of the replica,
+                     // -1 when closed
+    char *block;     // the input block
+    size_t block_len, written;
+    char *output;    // the output, buffered until its turn
+    size_t output_len, output_cap;
+};
+
+/** Input read from stdin, not yet cut into blocks */
+struct carry {
+    char *buf;
+    size_t len, cap;
+    int eof;
+};
+
+/**
+ * @brief Grows a buffer to hold at least `need` bytes. Exits on failure
+ */
+static void reserve(char **buf, size_t *cap, size_t need) {
+    if (need <= *cap)
+        return;
+    size_t new_cap = *cap == 0 ? 4096 : *cap;
+    while (new_cap < need)
+        new_cap *= 2;
+    char *bigger = realloc(*buf, new_cap);
+    if (bigger == NULL) {
+        fprintf(stderr, "Failed to allocate memory for a block\n");
+        exit(EXIT_FAILURE);
+    }
+    *buf = bigger;
+    *cap = new_cap;
+}
+
+/**
+ * @brief Length of the next block at the front of the input: up to the last
+ * newline within `REPLICA_BLOCK_SIZE` bytes, or the first one after it if a
+ * line is longer than that. At the end of the input, whatever is left
+ *
+ * @return The length of the block, or 0 if more input is needed
+ */
+static size_t next_block(const struct carry *c) {
+    if (c->eof)
+        return c->len;
+    if (c->len < REPLICA_BLOCK_SIZE)
+        return 0;
+    for (size_t i = REPLICA_BLOCK_SIZE; i > 0; i--)
+        if (c->buf[i - 1] == '\n')
+            return i;
+    char *nl = memchr(c->buf + REPLICA_BLOCK_SIZE, '\n',
+                      c->len - REPLICA_BLOCK_SIZE);
+    return nl == NULL ? 0 : (size_t)(nl - c->buf) + 1;
+}
+
+/**
+ * @brief Starts a replica on a block of the input. Exits on failure
+ *
+ * @param job The free slot
+ * @param args The command and its arguments
+ * @param c The input, the block is removed from its front
+ * @param len The length of the block
+ * @param seq The position of the block
+ */
+static void start_job(struct job *job, char **args, struct carry *c,
+                      size_t len, size_t seq) {
+    int in[2], out[2];
+    // close-on-exec, so that replicas do not hold each other's pipes open
+    if (pipe2(in, O_CLOEXEC) == -1 || pipe2(out, O_CLOEXEC) == -1) {
+        fprintf(stderr, "Failed to create pipe: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    pid_t pid;
+    if ((pid = fork()) == -1) {
+        fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    } else if (pid == 0) {
+        dup2(in[PIPE_READ], STDIN_FILENO);
+        dup2(out[PIPE_WRITE], STDOUT_FILENO);
+        signal(SIGPIPE, SIG_DFL);
+        execvp(args[0], args);
+        perror("execvp");
+        _exit(EXIT_FAILURE);
+    }
+    close(in[PIPE_READ]);
+    close(out[PIPE_WRITE]);
+    // the launcher also reads the outputs, it must never block on a replica
+    fcntl(in[PIPE_WRITE], F_SETFL, O_NONBLOCK);
+
+    job->busy = 1;
+    job->seq = seq;
+    job->pid = pid;
+    job->in = in[PIPE_WRITE];
+    job->out = out[PIPE_READ];
+    job->block = malloc(len);
+    if (job->block == NULL) {
+        fprintf(stderr, "Failed to allocate memory for a block\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(job->block, c->buf, len);
+    job->block_len = len;
+    job->written = 0;
+    job->output_len = 0;
+    memmove(c->buf, c->buf + len, c->len - len);
+    c->len -= len;
+}
+
+/**
+ * @brief Writes the next part of a block to its replica
+ */
+static void feed_job(struct job *job) {
+    ssize_t bytes =
+        write(job->in, job->block + job->written, job->block_len - job->written);
+    if (bytes == -1 && errno == EAGAIN)
+        return;
+    if (bytes > 0)
+        job->written += bytes;
+    // done, or the replica stopped reading (e.g., `head`)
+    if (bytes == -1 || job->written == job->block_len) {
+        close(job->in);
+        job->in = -1;
+        free(job->block);
+        job->block = NULL;
+    }
+}
+
+/**
+ * @brief Reads the next part of the output of a replica, and reaps it at the
+ * end of the output, keeping its status
+ */
+static void drain_job(struct job *job) {
+    reserve(&job->output, &job->output_cap, job->output_len + 65536);
+    ssize_t bytes = read(job->out, job->output + job->output_len,
+                         job->output_cap - job->output_len);
+    if (bytes > 0) {
+        job->output_len += bytes;
+        return;
+    }
+    if (bytes == -1 && errno == EINTR)
+        return;
+    close(job->out);
+    job->out = -1;
+    int status;
+    while (waitpid(job->pid, &status, 0) == -1 && errno == EINTR)
+        ;
+    job->status = WIFEXITED(status) ? WEXITSTATUS(status)
+                                    : 128 + WTERMSIG(status);
+}
+
+/**
+ * @brief Writes the whole buffer to stdout. Exits on failure
+ */
+static void write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t bytes = write(STDOUT_FILENO, buf, len);
+        if (bytes == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EPIPE)
+                fprintf(stderr, "Failed to write output: %s\n",
+                        strerror(errno));
+            exit(errno == EPIPE ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        buf += bytes;
+        len -= bytes;
+    }
+}
+
+int run_replicated(char **args, int n) {
+    struct job *jobs = calloc(n, sizeof(*jobs));
+    struct pollfd *fds = malloc((2 * n + 1) * sizeof(*fds));
+    struct job **polled = malloc((2 * n + 1) * sizeof(*polled));
+    if (jobs == NULL || fds == NULL || polled == NULL) {
+        fprintf(stderr, "Failed to allocate memory for replicas\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < n; i++)
+        jobs[i].in = jobs[i].out = -1;
+    // a replica that exits early must not kill the launcher
+    signal(SIGPIPE, SIG_IGN);
+
+    struct carry c = {0};
+    size_t next_seq = 0, next_emit = 0;
+    int running = 0, status = 0;
+    while (!c.eof || c.len > 0 || running > 0) {
+        // start replicas on the available blocks
+        size_t len;
+        for (int i = 0; i < n && c.len > 0 && (len = next_block(&c)) > 0; i++)
+            if (!jobs[i].busy) {
+                start_job(&jobs[i], args, &c, len, next_seq++);
+                running++;
+            }
+
+        // write the finished outputs, in the order of the blocks
+        for (int found = 1; found;) {
+            found = 0;
+            for (int i = 0; i < n; i++) {
+                struct job *job = &jobs[i];
+                if (job->busy && job->seq == next_emit && job->in == -1 &&
+                    job->out == -1) {
+                    write_all(job->output, job->output_len);
+                    // the first failure, in the order of the blocks
+                    if (status == 0)
+                        status = job->status;
+                    job->busy = 0;
+                    running--;
+                    next_emit++;
+                    found = 1;
+                }
+            }
+        }
+
+        // wait for input, for replicas ready to read and for their outputs
+        int nfds = 0;
+        if (!c.eof && running < n) {
+            fds[nfds] = (struct pollfd){.fd = STDIN_FILENO, .events = POLLIN};
+            polled[nfds++] = NULL;
+        }
+        for (int i = 0; i < n; i++) {
+            if (jobs[i].in != -1) {
+                fds[nfds] = (struct pollfd){.fd = jobs[i].in, .events = POLLOUT};
+                polled[nfds++] = &jobs[i];
+            }
+            if (jobs[i].out != -1) {
+                fds[nfds] = (struct pollfd){.fd = jobs[i].out, .events = POLLIN};
+                polled[nfds++] = &jobs[i];
+            }
+        }
+        if (nfds == 0)
+            continue;
+        if (poll(fds, nfds, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Failed to poll: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < nfds; i++) {
+            if (fds[i].revents == 0)
+                continue;
+            if (polled[i] == NULL) {
+                reserve(&c.buf, &c.cap, c.len + 65536);
+                ssize_t bytes = read(STDIN_FILENO, c.buf + c.len, c.cap - c.len);
+                if (bytes > 0)
+                    c.len += bytes;
+                else if (bytes == 0 || errno != EINTR)
+                    c.eof = 1;
+            } else if (fds[i].fd == polled[i]->in) {
+                feed_job(polled[i]);
+            } else {
+                drain_job(polled[i]);
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+        free(jobs[i].output);
+    free(jobs);
+    free(fds);
+    free(polled);
+    free(c.buf);
+    return status;
+}
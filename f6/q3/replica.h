@@ -0,0 +1,32 @@
+/**
+ * Replicated stages for the pipelines of `sol.c`, similar to
+ * `parallel --pipe --keep-order`.
+ *
+ * The input of the stage is split into blocks of about `REPLICA_BLOCK_SIZE`
+ * bytes, cut at line boundaries. Each block is fed to a new process running
+ * the command, with up to `n` of them at the same time. The output of each
+ * block is buffered and written in the order of the blocks, so the next stage
+ * sees the same lines as if the command had run once on the whole input.
+ *
+ * A process per block, rather than `n` long-lived processes, is what makes
+ * the order recoverable: the end of the output of a block is the end of the
+ * output of its process.
+ */
+#ifndef REPLICA_H
+#define REPLICA_H
+
+#define REPLICA_BLOCK_SIZE (1 << 20)
+
+/**
+ * @brief Runs `n` replicas of a command over stdin, writing their outputs to
+ * stdout in the order of the input. Exits on failure
+ *
+ * @param args The command and its arguments, null terminated
+ * @param n The maximum number of replicas running at the same time
+ * @return 0 if every replica succeeded, else the status of the first one
+ * that failed, in the order of the blocks: its exit code, or 128 + the signal
+ * that killed it, as in the shell
+ */
+int run_replicated(char **args, int n);
+
+#endif
@@ -5,6 +5,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "instrument.h"
+#include "replica.h"
+
 #define PIPE_READ 0
 #define PIPE_WRITE 1
 
@@ -63,16 +66,38 @@ int parse_cmds(char *cmd, char ***args) {
     return 0;
 }
 
+/**
+ * @brief Parses the number of replicas of a stage, e.g., `4x` in
+ * `4x grep printf`
+ *
+ * @param arg The first token of the stage
+ * @return The number of replicas, or 0 if `arg` is not of the form `<n>x`
+ */
+int parse_replicas(const char *arg) {
+    char *end;
+    long n = strtol(arg, &end, 10);
+    if (end == arg || strcmp(end, "x") != 0 || n <= 0 || n > 1024)
+        return 0;
+    return n;
+}
+
 /**
  * @brief Executes a command string
  *
- * @param cmd The string command, e.g., `ls -l -a`
+ * @param cmd The string command, e.g., `ls -l -a`, or `4x grep printf` to run
+ * it with 4 replicas (see `replica.h`)
  * @return int
  */
 int run_cmd(char *cmd) {
     char **args;
     parse_cmds(cmd, &args);
 
+    int replicas;
+    if (args[0] != NULL && args[1] != NULL &&
+        (replicas = parse_replicas(args[0])) > 0) {
+        exit(run_replicated(&args[1], replicas));
+    }
+
     if (execvp(args[0], args) == -1) {
         perror("execvp");
         exit(EXIT_FAILURE);
@@ -140,23 +165,77 @@ void next_pipe(char *piped_cmds) {
     }
 }
 
-int main(int argc, char const *argv[]) {
-    // validate arguments
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s \"cmd_1 | cmd_2 -a | ... | cmd_n\"\n",
-                argv[0]);
+/**
+ * @brief Splits a chain of piped commands into its stages
+ *
+ * @param piped_cmds The chain of piped commands, split in place
+ * @param stages Return by parameter the array of stages
+ * @return The number of stages
+ */
+int split_stages(char *piped_cmds, char ***stages) {
+    int n = 0, cap = 10;
+    char **aux = malloc(sizeof(char *) * cap);
+    char *tok;
+    for (tok = strtok(piped_cmds, "|"); aux != NULL && tok != NULL;
+         tok = strtok(NULL, "|")) {
+        if (n == cap) {
+            cap += 10;
+            aux = realloc(aux, sizeof(char *) * cap);
+            if (aux == NULL)
+                break;
+        }
+        aux[n++] = tok;
+    }
+    if (aux == NULL) {
+        fprintf(stderr, "Failed to allocate memory for stages array\n");
         exit(EXIT_FAILURE);
     }
+    *stages = aux;
+    return n;
+}
 
-    // copy argv1
-    char *cmd = malloc(sizeof(char) * (strlen(argv[1]) + 1));
+void usage(char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-s] [-j stats.json] \"cmd_1 | cmd_2 -a | ... | "
+            "cmd_n\"\n"
+            "A stage prefixed with <n>x, e.g., \"cat f | 4x grep a | wc\", "
+            "runs with n replicas\n"
+            "  -s  report per-stage statistics to stderr\n"
+            "  -j  write per-stage statistics as JSON\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    // validate arguments
+    int human = 0;
+    char *json_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "sj:")) != -1) {
+        if (opt == 's')
+            human = 1;
+        else if (opt == 'j')
+            json_path = optarg;
+        else
+            usage(argv[0]);
+    }
+    if (argc - optind != 1)
+        usage(argv[0]);
+
+    // copy the command string
+    char *cmd = malloc(sizeof(char) * (strlen(argv[optind]) + 1));
     if (cmd == NULL) {
         fprintf(stderr, "Failed to allocate memory for command string\n");
         exit(EXIT_FAILURE);
     }
-    strcpy(cmd, argv[1]);
+    strcpy(cmd, argv[optind]);
 
-    // run commands
+    // run commands, instrumented if asked for statistics
+    if (human || json_path != NULL) {
+        char **stages;
+        int nstages = split_stages(cmd, &stages);
+        return run_instrumented(stages, nstages, run_cmd, human, json_path);
+    }
     next_pipe(cmd);
     return 0;
 }
@@ -0,0 +1,340 @@
+/**
+ * Variant of `original.c` where both directions stream at the same time. The
+ * parent sends `n` bytes to the child, which echoes them back, and the parent
+ * checks that it gets the same bytes in the same order.
+ *
+ * With a blocking `write` followed by a `read` on each side, this deadlocks as
+ * soon as the payload is larger than the socket buffers: the child blocks
+ * writing the echo, which the parent does not read because it is itself
+ * blocked writing. Here, both sockets are non-blocking and each side waits
+ * with `poll` for whichever direction can make progress. Each direction has
+ * its own buffer: the child a ring buffer between its input and its output,
+ * the parent a fixed pattern to send and a buffer for what it receives.
+ *
+ * The sizes of the socket buffers can be set with `-b` (`SO_SNDBUF` and
+ * `SO_RCVBUF`), and the size of the chunks moved per system call with `-c`.
+ * With `-a policy`, the parent and the child pin themselves as workers 0 and
+ * 1 of a policy of `f7/lib/placement.h`, recorded with the result.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../f7/lib/placement.h"
+
+#define SOCK_PARENT 0
+#define SOCK_CHILD 1
+
+/** Length of the sent pattern. Prime, so that shifted data does not match */
+#define PATTERN_LEN 65521
+
+/** Ring buffer between the input and the output of the child */
+struct ring {
+    char *data;
+    size_t cap;
+    size_t head; // next byte to be written out
+    size_t len;  // bytes held
+};
+
+/**
+ * @brief Current time of the monotonic clock, in seconds
+ */
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Parses a size with an optional K, M or G suffix (powers of 1024)
+ *
+ * @return The size, or 0 if invalid
+ */
+size_t parse_size(const char *s) {
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    switch (*end) {
+        case 'G':
+        case 'g':
+            v <<= 10; // fall through
+        case 'M':
+        case 'm':
+            v <<= 10; // fall through
+        case 'K':
+        case 'k':
+            v <<= 10;
+            end++;
+    }
+    return *end == '\0' ? v : 0;
+}
+
+/**
+ * @brief Reads from a socket into the free space of the ring
+ *
+ * @return The number of bytes read, 0 on end of stream, -1 on error (`EAGAIN`
+ * if nothing is available)
+ */
+ssize_t ring_read(struct ring *r, int fd) {
+    size_t tail = (r->head + r->len) % r->cap;
+    size_t contiguous = tail >= r->head && r->len < r->cap ? r->cap - tail
+                                                           : r->cap - r->len;
+    ssize_t bytes = read(fd, r->data + tail, contiguous);
+    if (bytes > 0)
+        r->len += bytes;
+    return bytes;
+}
+
+/**
+ * @brief Writes the data held in the ring to a socket
+ *
+ * @return The number of bytes written, -1 on error (`EAGAIN` if the socket
+ * buffer is full)
+ */
+ssize_t ring_write(struct ring *r, int fd) {
+    size_t contiguous = r->head + r->len <= r->cap ? r->len : r->cap - r->head;
+    ssize_t bytes = write(fd, r->data + r->head, contiguous);
+    if (bytes > 0) {
+        r->head = (r->head + bytes) % r->cap;
+        r->len -= bytes;
+        if (r->len == 0)
+            r->head = 0; // keep the next read contiguous
+    }
+    return bytes;
+}
+
+/**
+ * @brief Echoes everything received on the socket back to it, until the
+ * parent shuts down its side and the ring is empty
+ *
+ * @param fd The non-blocking socket
+ * @param chunk The capacity of the ring buffer
+ */
+void child(int fd, size_t chunk) {
+    struct ring r = {.data = malloc(chunk), .cap = chunk};
+    if (r.data == NULL) {
+        perror("malloc");
+        _exit(EXIT_FAILURE);
+    }
+    int eof = 0;
+    while (!eof || r.len > 0) {
+        struct pollfd pfd = {.fd = fd, .events = 0};
+        if (!eof && r.len < r.cap)
+            pfd.events |= POLLIN;
+        if (r.len > 0)
+            pfd.events |= POLLOUT;
+        if (poll(&pfd, 1, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            _exit(EXIT_FAILURE);
+        }
+        if (pfd.revents & (POLLIN | POLLHUP)) {
+            ssize_t bytes = ring_read(&r, fd);
+            if (bytes == 0)
+                eof = 1;
+            else if (bytes == -1 && errno != EAGAIN && errno != EINTR) {
+                perror("read");
+                _exit(EXIT_FAILURE);
+            }
+        }
+        if (pfd.revents & POLLOUT) {
+            if (ring_write(&r, fd) == -1 && errno != EAGAIN &&
+                errno != EINTR) {
+                perror("write");
+                _exit(EXIT_FAILURE);
+            }
+        }
+    }
+    // tell the parent the echo is complete
+    shutdown(fd, SHUT_WR);
+    free(r.data);
+}
+
+/**
+ * @brief Streams `n` bytes of the pattern to the child and checks the echo,
+ * both at the same time. Exits on failure
+ *
+ * @param fd The non-blocking socket
+ * @param n The number of bytes
+ * @param chunk The maximum number of bytes per system call
+ * @param pattern The pattern, repeated twice so that any offset in it can be
+ * followed by up to `PATTERN_LEN` contiguous bytes
+ * @param polls Output, the number of calls to `poll`
+ */
+void parent(int fd, size_t n, size_t chunk, const char *pattern,
+            long *polls) {
+    if (chunk > PATTERN_LEN)
+        chunk = PATTERN_LEN;
+    char *rx = malloc(chunk);
+    if (rx == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t sent = 0, received = 0;
+    int shut = 0;
+    *polls = 0;
+    while (received < n) {
+        if (sent == n && !shut) {
+            shutdown(fd, SHUT_WR); // the child stops at end of stream
+            shut = 1;
+        }
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (sent < n)
+            pfd.events |= POLLOUT;
+        (*polls)++;
+        if (poll(&pfd, 1, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+
+        if (pfd.revents & POLLOUT) {
+            size_t len = n - sent < chunk ? n - sent : chunk;
+            ssize_t bytes = write(fd, pattern + sent % PATTERN_LEN, len);
+            if (bytes > 0)
+                sent += bytes;
+            else if (errno != EAGAIN && errno != EINTR) {
+                perror("write");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (pfd.revents & (POLLIN | POLLHUP)) {
+            ssize_t bytes = read(fd, rx, chunk);
+            if (bytes == 0 || (bytes == -1 && errno != EAGAIN &&
+                               errno != EINTR)) {
+                fprintf(stderr, "Echo ended after %zu of %zu bytes. Cause: %s\n",
+                        received, n,
+                        bytes == 0 ? "end of stream" : strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            if (bytes > 0) {
+                if (memcmp(rx, pattern + received % PATTERN_LEN, bytes) != 0) {
+                    fprintf(stderr, "Echo differs near byte %zu\n", received);
+                    exit(EXIT_FAILURE);
+                }
+                received += bytes;
+            }
+        }
+    }
+    free(rx);
+}
+
+void usage(char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-n bytes] [-b sockbuf] [-c chunk] [-a policy]\n"
+            "  -n  bytes to stream each way, K/M/G suffixes (default 1G)\n"
+            "  -b  SO_SNDBUF and SO_RCVBUF of both sockets (default: system)\n"
+            "  -c  bytes per read/write, and size of the echo buffer "
+            "(default 64K)\n"
+            "  -a  pin the processes: none (default), compact, scatter or "
+            "node\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = 1ul << 30, sockbuf = 0, chunk = 1 << 16;
+    int policy = PLACE_NONE, opt;
+    while ((opt = getopt(argc, argv, "n:b:c:a:")) != -1) {
+        switch (opt) {
+            case 'n':
+                if ((n = parse_size(optarg)) == 0)
+                    usage(argv[0]);
+                break;
+            case 'b':
+                if ((sockbuf = parse_size(optarg)) == 0)
+                    usage(argv[0]);
+                break;
+            case 'c':
+                if ((chunk = parse_size(optarg)) == 0)
+                    usage(argv[0]);
+                break;
+            case 'a':
+                if ((policy = placement_parse(optarg)) == -1)
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (placement_set(policy) == -1) {
+        fprintf(stderr, "Failed to read the topology. Cause: %s\n",
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+        perror("opening stream socket pair");
+        exit(1);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (sockbuf > 0) {
+            int size = sockbuf;
+            if (setsockopt(sockets[i], SOL_SOCKET, SO_SNDBUF, &size,
+                           sizeof(size)) == -1 ||
+                setsockopt(sockets[i], SOL_SOCKET, SO_RCVBUF, &size,
+                           sizeof(size)) == -1) {
+                perror("setsockopt");
+                return EXIT_FAILURE;
+            }
+        }
+        fcntl(sockets[i], F_SETFL, O_NONBLOCK);
+    }
+    int actual;
+    socklen_t len = sizeof(actual);
+    getsockopt(sockets[SOCK_PARENT], SOL_SOCKET, SO_SNDBUF, &actual, &len);
+
+    pid_t pid;
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        return EXIT_FAILURE;
+    } else if (pid == 0) {
+        /* this is the child */
+        if (placement_apply(1) == -1)
+            perror("placement_apply");
+        close(sockets[SOCK_PARENT]);
+        child(sockets[SOCK_CHILD], chunk);
+        _exit(EXIT_SUCCESS);
+    }
+
+    /* this is the parent */
+    if (placement_apply(0) == -1)
+        perror("placement_apply");
+    close(sockets[SOCK_CHILD]);
+    char *pattern = malloc(2 * PATTERN_LEN);
+    if (pattern == NULL) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < 2 * PATTERN_LEN; i++)
+        pattern[i] = (i % PATTERN_LEN) * 131 + (i % PATTERN_LEN) / 256;
+
+    long polls;
+    double start = now();
+    parent(sockets[SOCK_PARENT], n, chunk, pattern, &polls);
+    double elapsed = now() - start;
+    printf("%zu bytes each way in %.3f s, %.1f MB/s each way, %ld polls "
+           "(SO_SNDBUF %d, chunk %zu, placement %s)\n",
+           n, elapsed, n / elapsed / 1e6, polls, actual, chunk,
+           placement_name(policy));
+
+    close(sockets[SOCK_PARENT]);
+    free(pattern);
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("did not catch child exiting");
+        return EXIT_FAILURE;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
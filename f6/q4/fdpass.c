@@ -0,0 +1,268 @@
+/**
+ * Variant of `sol.c` where the parent does not copy the file contents through
+ * the socket. Instead, it opens the files and sends the file descriptors
+ * themselves to the child, as ancillary data (`SCM_RIGHTS`). The child then
+ * copies each file to stdout with `sendfile`, so the transfer cost in the
+ * socket is constant regardless of the file size.
+ *
+ * Several descriptors are sent in a single message, up to `MAX_FDS_PER_MSG`.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SOCK_PARENT 0
+#define SOCK_CHILD 1
+
+#define BUFSIZE 256
+#define MAX_FDS_PER_MSG 16
+
+/**
+ * @brief Sends a batch of file descriptors in a single message
+ *
+ * The message payload is the number of descriptors, which allows the receiver
+ * to validate the ancillary data.
+ *
+ * @param sock The socket to write to
+ * @param fds Array of file descriptors
+ * @param n Number of descriptors in `fds`, at most `MAX_FDS_PER_MSG`
+ * @retval -1 - Error, `errno` is set by `sendmsg`
+ * @retval 0 - OK
+ */
+int send_fds(int sock, int *fds, int n) {
+    unsigned char count = n;
+    struct iovec iov = {.iov_base = &count, .iov_len = sizeof(count)};
+
+    // the control buffer must be suitably aligned for a 'struct cmsghdr'
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * MAX_FDS_PER_MSG)];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n);
+
+    return sendmsg(sock, &msg, 0) == -1 ? -1 : 0;
+}
+
+/**
+ * @brief Receives a batch of file descriptors sent with `send_fds`
+ *
+ * @param sock The socket to read from
+ * @param fds Output array, with room for `MAX_FDS_PER_MSG` descriptors
+ * @return The number of descriptors received, 0 on end of stream, or -1 on
+ * error
+ */
+int recv_fds(int sock, int *fds) {
+    unsigned char count;
+    struct iovec iov = {.iov_base = &count, .iov_len = sizeof(count)};
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * MAX_FDS_PER_MSG)];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t bytes = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (bytes <= 0)
+        return bytes;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if ((msg.msg_flags & MSG_CTRUNC) || cmsg == NULL ||
+        cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * n);
+    if (n != count) { // descriptors were dropped on the way, e.g. RLIMIT_NOFILE
+        for (int i = 0; i < n; i++)
+            close(fds[i]);
+        errno = EBADMSG;
+        return -1;
+    }
+    return n;
+}
+
+/**
+ * @brief Copies the contents of a file descriptor to stdout. Uses `sendfile`,
+ * and falls back to a `read`/`write` loop if the descriptors do not support it
+ *
+ * @param fd The file descriptor to copy from
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+int copy_to_stdout(int fd) {
+    ssize_t bytes;
+    while ((bytes = sendfile(STDOUT_FILENO, fd, NULL, 1 << 30)) > 0)
+        ;
+    if (bytes == 0)
+        return 0;
+    if (errno != EINVAL && errno != ENOSYS)
+        return -1;
+
+    char buf[BUFSIZE];
+    while ((bytes = read(fd, buf, BUFSIZE)) > 0) {
+        if (write(STDOUT_FILENO, buf, bytes) == -1)
+            return -1;
+    }
+    return bytes == -1 ? -1 : 0;
+}
+
+/**
+ * @brief Sends a batch of descriptors to the child and closes our references.
+ * Exits on failure
+ *
+ * @param sock The socket to write to
+ * @param fds Array of file descriptors
+ * @param n Number of descriptors in `fds`
+ */
+void flush_batch(int sock, int *fds, int n) {
+    if (send_fds(sock, fds, n) == -1) {
+        fprintf(stderr, "Failed to send descriptors. Cause: %s\n",
+                strerror(errno));
+        close(sock);
+        exit(EXIT_FAILURE);
+    }
+    // the child holds its own references now, close ours
+    for (int i = 0; i < n; i++)
+        close(fds[i]);
+}
+
+/**
+ * @brief Opens each file and sends the descriptors to the child, in batches of
+ * up to `MAX_FDS_PER_MSG`
+ *
+ * @param filenames Array of filenames
+ * @param nfiles Number of filenames
+ * @param sockets A pair of connected sockets file descriptors
+ * @return The number of files that could not be opened, which are skipped
+ */
+int parent(char **filenames, int nfiles, int sockets[2]) {
+    /* close childs socket */
+    close(sockets[SOCK_CHILD]);
+
+    int fds[MAX_FDS_PER_MSG];
+    int n = 0; // number of descriptors in the current batch
+    int failed = 0;
+    for (int i = 0; i < nfiles; i++) {
+        /* open the file in read mode */
+        if ((fds[n] = open(filenames[i], O_RDONLY)) == -1) {
+            fprintf(stderr, "Failed to open file '%s'. Cause: %s\n",
+                    filenames[i], strerror(errno));
+            failed++;
+            continue;
+        }
+        if (++n == MAX_FDS_PER_MSG) {
+            flush_batch(sockets[SOCK_PARENT], fds, n);
+            n = 0;
+        }
+    }
+    if (n > 0)
+        flush_batch(sockets[SOCK_PARENT], fds, n);
+
+    /* close socket, so that child gets end of stream */
+    close(sockets[SOCK_PARENT]);
+    return failed;
+}
+
+/**
+ * @brief Receives file descriptors from `sockets[SOCK_CHILD]` and prints the
+ * contents of each file in stdout
+ *
+ * @param sockets A pair of connected sockets file descriptors
+ * @return The number of files that could not be copied
+ */
+int child(int sockets[2]) {
+    /* close parents socket */
+    close(sockets[SOCK_PARENT]);
+
+    int fds[MAX_FDS_PER_MSG];
+    int n, failed = 0;
+    while ((n = recv_fds(sockets[SOCK_CHILD], fds)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (copy_to_stdout(fds[i]) == -1) {
+                fprintf(stderr, "Error while copying file. Cause: %s\n",
+                        strerror(errno));
+                failed++;
+            }
+            close(fds[i]);
+        }
+    }
+
+    if (n == -1) { // handle errors while reading from socket
+        fprintf(stderr, "Error while reading from socket. Cause: %s\n",
+                strerror(errno));
+        close(sockets[SOCK_CHILD]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* close socket */
+    close(sockets[SOCK_CHILD]);
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    /* validate arguments */
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <filename> [filename ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /*
+     * create a pair of connected UNIX sockets. SOCK_SEQPACKET preserves the
+     * message boundaries, so each batch of descriptors is received on its own
+     */
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets) < 0) {
+        perror("opening seqpacket socket pair");
+        return EXIT_FAILURE;
+    }
+
+    /* create process */
+    pid_t pid;
+    if ((pid = fork()) < 0) { // error
+        perror("fork");
+        return EXIT_FAILURE;
+    } else if (pid == 0) { // child
+        return child(sockets) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else { // parent
+        // the other files are still printed, but any failure fails the run
+        int failed = parent(argv + 1, argc - 1, sockets);
+
+        // wait for child and exit
+        int status;
+        if (waitpid(pid, &status, 0) < 0) {
+            perror("did not catch child exiting");
+            return EXIT_FAILURE;
+        }
+        if (failed > 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        return EXIT_SUCCESS;
+    }
+}
@@ -0,0 +1,85 @@
+#define _GNU_SOURCE // sendmmsg, recvmmsg
+
+#include "rpc.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+
+int rpc_pair(int fds[2]) {
+    return socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds);
+}
+
+int rpc_send(int fd, const struct rpc_msg *msgs, int n) {
+    struct mmsghdr hdrs[RPC_MAX_BATCH];
+    struct iovec iovs[RPC_MAX_BATCH];
+    int sent = 0;
+    while (sent < n) {
+        int batch = n - sent < RPC_MAX_BATCH ? n - sent : RPC_MAX_BATCH;
+        memset(hdrs, 0, batch * sizeof(*hdrs));
+        for (int i = 0; i < batch; i++) {
+            iovs[i].iov_base = (void *)&msgs[sent + i];
+            iovs[i].iov_len = RPC_HEADER_SIZE + msgs[sent + i].len;
+            hdrs[i].msg_hdr.msg_iov = &iovs[i];
+            hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+        // may send fewer than asked, when the socket buffer fills up
+        int r = sendmmsg(fd, hdrs, batch, 0);
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        sent += r;
+    }
+    return 0;
+}
+
+int rpc_recv(int fd, struct rpc_msg *msgs, int max) {
+    struct mmsghdr hdrs[RPC_MAX_BATCH];
+    struct iovec iovs[RPC_MAX_BATCH];
+    if (max > RPC_MAX_BATCH)
+        max = RPC_MAX_BATCH;
+    memset(hdrs, 0, max * sizeof(*hdrs));
+    for (int i = 0; i < max; i++) {
+        iovs[i].iov_base = &msgs[i];
+        iovs[i].iov_len = sizeof(msgs[i]);
+        hdrs[i].msg_hdr.msg_iov = &iovs[i];
+        hdrs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // block for the first message only, then take whatever is queued
+    int n;
+    do {
+        n = recvmmsg(fd, hdrs, max, MSG_WAITFORONE, NULL);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0)
+        return n;
+
+    for (int i = 0; i < n; i++) {
+        if (hdrs[i].msg_len == 0) // end of stream
+            return i;
+        if (hdrs[i].msg_len < RPC_HEADER_SIZE ||
+            hdrs[i].msg_len != RPC_HEADER_SIZE + msgs[i].len ||
+            (hdrs[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+            errno = EPROTO;
+            return -1;
+        }
+    }
+    return n;
+}
+
+int rpc_serve(int fd, rpc_handler handler, void *arg) {
+    struct rpc_msg reqs[RPC_MAX_BATCH], resps[RPC_MAX_BATCH];
+    for (;;) {
+        int n = rpc_recv(fd, reqs, RPC_MAX_BATCH);
+        if (n <= 0)
+            return n;
+        for (int i = 0; i < n; i++) {
+            handler(&reqs[i], &resps[i], arg);
+            resps[i].id = reqs[i].id;
+        }
+        if (rpc_send(fd, resps, n) == -1)
+            return -1;
+    }
+}
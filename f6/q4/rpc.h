@@ -0,0 +1,91 @@
+/**
+ * Small request/response RPC layer over a `SOCK_SEQPACKET` socket pair, the
+ * pattern of `original.c` with framing and batching.
+ *
+ * Each message is one packet, so the socket keeps the message boundaries and
+ * no length prefix has to be parsed. `rpc_send` and `rpc_recv` move a whole
+ * batch of messages per system call with `sendmmsg`/`recvmmsg`. Requests
+ * carry an id, copied to their response, so a client can pipeline many of
+ * them and match the responses as they come back.
+ */
+#ifndef RPC_H
+#define RPC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RPC_MAX_PAYLOAD 240
+#define RPC_MAX_BATCH 64
+
+enum rpc_op {
+    RPC_OP_ECHO = 1, // the response carries the same payload
+    RPC_OP_ERROR,    // response to an unknown request
+};
+
+/** A request or a response. Only the first `RPC_HEADER_SIZE + len` bytes are
+ * sent */
+struct rpc_msg {
+    uint32_t id;
+    uint16_t op;
+    uint16_t len; // bytes used in `payload`
+    char payload[RPC_MAX_PAYLOAD];
+};
+
+#define RPC_HEADER_SIZE offsetof(struct rpc_msg, payload)
+
+/**
+ * @brief Handles a request, called by `rpc_serve`
+ *
+ * @param req The request
+ * @param resp Output, the response. Its id is set by `rpc_serve`
+ * @param arg The argument given to `rpc_serve`
+ */
+typedef void (*rpc_handler)(const struct rpc_msg *req, struct rpc_msg *resp,
+                            void *arg);
+
+/**
+ * @brief Creates a connected pair of `SOCK_SEQPACKET` sockets
+ *
+ * @param fds Output, the sockets
+ * @retval -1 - Error, `errno` is set by `socketpair`
+ * @retval 0 - OK
+ */
+int rpc_pair(int fds[2]);
+
+/**
+ * @brief Sends messages, up to `RPC_MAX_BATCH` per system call. Blocks until
+ * all are sent
+ *
+ * @param fd The socket
+ * @param msgs The messages
+ * @param n The number of messages
+ * @retval -1 - Error, `errno` is set by `sendmmsg`
+ * @retval 0 - OK
+ */
+int rpc_send(int fd, const struct rpc_msg *msgs, int n);
+
+/**
+ * @brief Receives at least one message, and as many as are already queued, up
+ * to `max` (at most `RPC_MAX_BATCH`), in a single system call
+ *
+ * @param fd The socket
+ * @param msgs Output, the messages
+ * @param max The capacity of `msgs`
+ * @return The number of messages, 0 if the peer closed the socket, or -1 on
+ * error (`errno` is set accordingly, `EPROTO` for a malformed message)
+ */
+int rpc_recv(int fd, struct rpc_msg *msgs, int max);
+
+/**
+ * @brief Serves requests until the peer closes the socket. Requests are
+ * received and responses sent in batches
+ *
+ * @param fd The socket
+ * @param handler Handles each request
+ * @param arg Passed to `handler`
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - The peer closed the socket
+ */
+int rpc_serve(int fd, rpc_handler handler, void *arg);
+
+#endif
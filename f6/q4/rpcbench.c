@@ -0,0 +1,217 @@
+/**
+ * Benchmark of the RPC layer from `rpc.h`. The child serves echo requests;
+ * the parent sends `n` requests and measures throughput and latency.
+ *
+ * The first run is the ping-pong of `original.c`: one request in flight, one
+ * system call per message in each direction. The other runs send batches of
+ * 1, 2, 4, ... requests with a single `sendmmsg`, keeping up to two batches
+ * in flight, and read the responses with `recvmmsg` as they come.
+ *
+ * Each request carries its send time in the payload, echoed back by the
+ * child, so the latency is measured per request without any table.
+ *
+ * With `-a policy`, the client and the server pin themselves as workers 0
+ * and 1 of a policy of `f7/lib/placement.h`, recorded with the results.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../f7/lib/placement.h"
+#include "rpc.h"
+
+#define SOCK_PARENT 0
+#define SOCK_CHILD 1
+
+/**
+ * @brief Current time of the monotonic clock, in seconds
+ */
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Handler of the child: echoes the payload back
+ */
+void echo(const struct rpc_msg *req, struct rpc_msg *resp, void *arg) {
+    (void)arg;
+    if (req->op != RPC_OP_ECHO) {
+        resp->op = RPC_OP_ERROR;
+        resp->len = 0;
+        return;
+    }
+    resp->op = RPC_OP_ECHO;
+    resp->len = req->len;
+    memcpy(resp->payload, req->payload, req->len);
+}
+
+int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Sends `n` requests in batches of `batch`, with up to `window` in
+ * flight, and prints the throughput and latency. Exits on failure
+ *
+ * @param fd The socket
+ * @param n The number of requests
+ * @param batch The number of requests per `sendmmsg`
+ * @param window The maximum number of requests in flight
+ * @param size The size of the payload, at least `sizeof(double)`
+ * @param latencies Scratch space for `n` latencies
+ */
+void run(int fd, long n, int batch, int window, int size, double *latencies) {
+    struct rpc_msg reqs[RPC_MAX_BATCH], resps[RPC_MAX_BATCH];
+    memset(reqs, 0, sizeof(reqs));
+    long sent = 0, received = 0, syscalls = 0;
+    uint32_t next_id = 0;
+
+    double start = now();
+    while (received < n) {
+        // fill the window, one batch per system call
+        while (sent < n && sent - received + batch <= window) {
+            int k = n - sent < batch ? n - sent : batch;
+            double t = now();
+            for (int i = 0; i < k; i++) {
+                reqs[i].id = sent + i;
+                reqs[i].op = RPC_OP_ECHO;
+                reqs[i].len = size;
+                memcpy(reqs[i].payload, &t, sizeof(t));
+            }
+            if (rpc_send(fd, reqs, k) == -1) {
+                fprintf(stderr, "Failed to send. Cause: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            sent += k;
+            syscalls++;
+        }
+
+        // take whatever responses are there, at least one
+        int k = rpc_recv(fd, resps, RPC_MAX_BATCH);
+        syscalls++;
+        if (k <= 0) {
+            fprintf(stderr, "Failed to receive. Cause: %s\n",
+                    k == 0 ? "connection closed" : strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        double t = now();
+        for (int i = 0; i < k; i++) {
+            // the child answers in order, anything else is a protocol error
+            if (resps[i].id != next_id++ || resps[i].op != RPC_OP_ECHO) {
+                fprintf(stderr, "Unexpected response %u\n", resps[i].id);
+                exit(EXIT_FAILURE);
+            }
+            double sent_at;
+            memcpy(&sent_at, resps[i].payload, sizeof(sent_at));
+            latencies[received++] = t - sent_at;
+        }
+    }
+    double elapsed = now() - start;
+
+    qsort(latencies, n, sizeof(*latencies), cmp_double);
+    printf("%6d %7d %12.0f %10.2f %10.2f %10.2f %10.3f\n", batch, window,
+           n / elapsed, latencies[n / 2] * 1e6, latencies[n * 99 / 100] * 1e6,
+           latencies[n - 1] * 1e6, (double)syscalls / n);
+}
+
+void usage(char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-n requests] [-s payload_size] [-b max_batch] "
+            "[-a policy]\n"
+            "  -n  requests per run (default 1000000)\n"
+            "  -s  payload size, %zu to %d bytes (default 16)\n"
+            "  -b  largest batch, at most %d (default %d)\n"
+            "  -a  pin the processes: none (default), compact, scatter or "
+            "node\n",
+            prog, sizeof(double), RPC_MAX_PAYLOAD, RPC_MAX_BATCH,
+            RPC_MAX_BATCH);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    long n = 1000000;
+    int size = 16, max_batch = RPC_MAX_BATCH;
+    int policy = PLACE_NONE, opt;
+    while ((opt = getopt(argc, argv, "n:s:b:a:")) != -1) {
+        switch (opt) {
+            case 'n':
+                n = atol(optarg);
+                break;
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 'b':
+                max_batch = atoi(optarg);
+                break;
+            case 'a':
+                if ((policy = placement_parse(optarg)) == -1)
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (n <= 0 || size < (int)sizeof(double) || size > RPC_MAX_PAYLOAD ||
+        max_batch <= 0 || max_batch > RPC_MAX_BATCH)
+        usage(argv[0]);
+
+    if (placement_set(policy) == -1) {
+        fprintf(stderr, "Failed to read the topology. Cause: %s\n",
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    int sockets[2];
+    if (rpc_pair(sockets) == -1) {
+        perror("opening seqpacket socket pair");
+        return EXIT_FAILURE;
+    }
+
+    pid_t pid;
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        return EXIT_FAILURE;
+    } else if (pid == 0) {
+        /* this is the child, the server */
+        if (placement_apply(1) == -1)
+            perror("placement_apply");
+        close(sockets[SOCK_PARENT]);
+        if (rpc_serve(sockets[SOCK_CHILD], echo, NULL) == -1) {
+            perror("rpc_serve");
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    /* this is the parent, the client */
+    if (placement_apply(0) == -1)
+        perror("placement_apply");
+    close(sockets[SOCK_CHILD]);
+    double *latencies = malloc(n * sizeof(*latencies));
+    if (latencies == NULL) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    printf("%ld requests of %d bytes, placement %s\n", n, size,
+           placement_name(policy));
+    printf("%6s %7s %12s %10s %10s %10s %10s\n", "batch", "window", "req/s",
+           "p50_us", "p99_us", "max_us", "calls/req");
+    run(sockets[SOCK_PARENT], n, 1, 1, size, latencies); // ping-pong
+    for (int batch = 1; batch <= max_batch; batch *= 2)
+        run(sockets[SOCK_PARENT], n, batch, 2 * batch, size, latencies);
+
+    close(sockets[SOCK_PARENT]);
+    free(latencies);
+    if (waitpid(pid, NULL, 0) < 0) {
+        perror("did not catch child exiting");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,321 @@
+#include "cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parse.h"
+
+/**
+ * @brief 64-bit FNV-1a hash of a string
+ */
+static uint64_t fnv1a(const char *s) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (; *s != '\0'; s++)
+        h = (h ^ (unsigned char)*s) * 0x100000001b3ull;
+    return h;
+}
+
+/**
+ * @brief Prefix shared by every entry of a text file, whatever its version,
+ * i.e., `CACHE_PREFIX` followed by the hash of the absolute path
+ *
+ * @param path The pathname of the text file
+ * @param buf Output buffer, at least 64 bytes
+ * @retval -1 - Error, `errno` is set by `realpath`
+ * @retval 0 - OK
+ */
+static int entry_prefix(const char *path, char *buf) {
+    char abs[PATH_MAX];
+    if (realpath(path, abs) == NULL)
+        return -1;
+    sprintf(buf, CACHE_PREFIX "%016llx-", (unsigned long long)fnv1a(abs));
+    return 0;
+}
+
+/**
+ * @brief Checks whether a name in CACHE_DIR is a complete cache entry, i.e.,
+ * has the prefix and is not a temporary file still being written
+ */
+static int is_entry(const char *name) {
+    return strncmp(name, CACHE_PREFIX, strlen(CACHE_PREFIX)) == 0 &&
+           strstr(name, ".tmp") == NULL;
+}
+
+/**
+ * @brief Checks whether a name in CACHE_DIR is a temporary file left behind
+ * by a process that died while parsing (`<entry>.tmp<pid>`, the process no
+ * longer exists)
+ */
+static int is_orphan(const char *name) {
+    if (strncmp(name, CACHE_PREFIX, strlen(CACHE_PREFIX)) != 0)
+        return 0;
+    const char *tmp = strstr(name, ".tmp");
+    char *end = NULL;
+    long pid = tmp == NULL ? 0 : strtol(tmp + 4, &end, 10);
+    return pid > 0 && *end == '\0' && kill(pid, 0) == -1 && errno == ESRCH;
+}
+
+static int cmp_recent_first(const void *a, const void *b) {
+    const struct cache_entry *x = a, *y = b;
+    return (x->last_used < y->last_used) - (x->last_used > y->last_used);
+}
+
+int cache_list(struct cache_entry **entries) {
+    DIR *dir = opendir(CACHE_DIR);
+    if (dir == NULL)
+        return -1;
+
+    int len = 0, cap = 16;
+    struct cache_entry *list = malloc(cap * sizeof(*list));
+    if (list == NULL) {
+        closedir(dir);
+        return -1;
+    }
+
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (!is_entry(de->d_name))
+            continue;
+        int fd = openat(dirfd(dir), de->d_name, O_RDONLY);
+        if (fd == -1) // evicted meanwhile
+            continue;
+        struct stat st;
+        struct matrix_header hdr;
+        if (fstat(fd, &st) == -1 ||
+            pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+            close(fd);
+            continue;
+        }
+        close(fd);
+
+        if (len == cap) {
+            cap *= 2;
+            struct cache_entry *bigger = realloc(list, cap * sizeof(*list));
+            if (bigger == NULL) {
+                free(list);
+                closedir(dir);
+                return -1;
+            }
+            list = bigger;
+        }
+        struct cache_entry *e = &list[len++];
+        snprintf(e->name, sizeof(e->name), "%s", de->d_name);
+        e->size = st.st_size;
+        e->last_used = st.st_mtime; // updated on every hit
+        e->n = hdr.n;
+        e->dtype = hdr.dtype;
+    }
+    closedir(dir);
+
+    qsort(list, len, sizeof(*list), cmp_recent_first);
+    *entries = list;
+    return len;
+}
+
+/**
+ * @brief Unlinks the entries whose name starts with `prefix`, and the
+ * orphaned temporary files among them
+ *
+ * @return The number of entries evicted, or -1 on error
+ */
+static int evict_prefix(const char *prefix) {
+    DIR *dir = opendir(CACHE_DIR);
+    if (dir == NULL)
+        return -1;
+    int evicted = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, prefix, strlen(prefix)) != 0)
+            continue;
+        int entry = is_entry(de->d_name);
+        if ((entry || is_orphan(de->d_name)) &&
+            unlinkat(dirfd(dir), de->d_name, 0) == 0)
+            evicted += entry;
+    }
+    closedir(dir);
+    return evicted;
+}
+
+/**
+ * @brief Unlinks the orphaned temporary files of every text file, which are
+ * not entries and would never be evicted otherwise
+ */
+static void remove_orphans(void) {
+    DIR *dir = opendir(CACHE_DIR);
+    if (dir == NULL)
+        return;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL)
+        if (is_orphan(de->d_name))
+            unlinkat(dirfd(dir), de->d_name, 0);
+    closedir(dir);
+}
+
+int cache_evict(const char *path) {
+    char prefix[64];
+    if (path == NULL)
+        return evict_prefix(CACHE_PREFIX);
+    if (entry_prefix(path, prefix) == -1)
+        return -1;
+    return evict_prefix(prefix);
+}
+
+/**
+ * @brief Maximum size of the cache, from `Q5_CACHE_MAX` if set
+ */
+static size_t cache_max() {
+    const char *env = getenv("Q5_CACHE_MAX");
+    return env != NULL ? strtoull(env, NULL, 10) : CACHE_MAX_BYTES;
+}
+
+/**
+ * @brief Evicts the least recently used entries until `size` more bytes fit
+ * in the cache
+ *
+ * @param size The size of the entry to be added
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+static int make_room(size_t size) {
+    // the files of parses that were killed take memory too
+    remove_orphans();
+    struct cache_entry *entries;
+    int len = cache_list(&entries);
+    if (len == -1)
+        return -1;
+    size_t total = 0;
+    for (int i = 0; i < len; i++)
+        total += entries[i].size;
+    // the list is sorted from the most recently used, evict from the end
+    size_t max = cache_max();
+    for (int i = len - 1; i >= 0 && total + size > max; i--) {
+        char full[PATH_MAX];
+        snprintf(full, sizeof(full), CACHE_DIR "/%s", entries[i].name);
+        if (unlink(full) == 0)
+            total -= entries[i].size;
+    }
+    free(entries);
+    return 0;
+}
+
+/**
+ * @brief Parses a text matrix into a new file
+ *
+ * @param t The mapped text
+ * @param tmp The pathname of the new file
+ * @param nprocs The number of processes used to parse
+ * @retval -1 - Error, `errno` is set accordingly. The new file is removed
+ * @retval 0 - OK
+ */
+static int parse_into(const struct text *t, const char *tmp, int nprocs) {
+    struct matrix m;
+    if (matrix_create(tmp, t->n, DTYPE_INT32, &m) == -1)
+        return -1;
+
+    // reserve the memory now, or running out of it while parsing would
+    // raise SIGBUS instead of returning ENOSPC
+    int fd = open(tmp, O_RDWR);
+    int r = fd == -1 ? errno : posix_fallocate(fd, 0, m.size);
+    if (fd != -1)
+        close(fd);
+    if (r != 0) {
+        matrix_unmap(&m);
+        unlink(tmp);
+        errno = r;
+        return -1;
+    }
+
+    struct parse_error *errors =
+        malloc((nprocs * PARSE_MAX_ERRORS + 1) * sizeof(struct parse_error));
+    if (errors == NULL) {
+        matrix_unmap(&m);
+        unlink(tmp);
+        return -1;
+    }
+    int nerrors = text_parse(t, &m, nprocs, errors);
+    int saved_errno = errno;
+    for (int i = 0; i < nerrors; i++)
+        fprintf(stderr, "Row %zu: %s\n", errors[i].row, errors[i].msg);
+    free(errors);
+    matrix_unmap(&m);
+    if (nerrors != 0) {
+        unlink(tmp);
+        errno = nerrors == -1 ? saved_errno : EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Looks up a text matrix in the cache, and adds it if missing
+ *
+ * @param path The pathname of the text file
+ * @param nprocs The number of processes used to parse
+ * @param m Output, the matrix mapped read-only from the cache
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+static int cache_load(const char *path, int nprocs, struct matrix *m) {
+    struct stat st;
+    char prefix[64], full[PATH_MAX], tmp[PATH_MAX + 32];
+    if (stat(path, &st) == -1 || entry_prefix(path, prefix) == -1)
+        return -1;
+    // any change to the text file changes the name of the entry
+    snprintf(full, sizeof(full), CACHE_DIR "/%s%lx-%lx-%lx-%lx.%09lx", prefix,
+             (unsigned long)st.st_dev, (unsigned long)st.st_ino,
+             (unsigned long)st.st_size, (unsigned long)st.st_mtim.tv_sec,
+             (unsigned long)st.st_mtim.tv_nsec);
+
+    /* ------ hit: map it, and mark it as recently used ------ */
+    if (matrix_map(full, m) == 0) {
+        utimensat(AT_FDCWD, full, NULL, 0);
+        return 0;
+    }
+
+    /* ------ miss: parse into a temporary file, then publish it ------ */
+    struct text t;
+    if (text_open(path, &t) == -1)
+        return -1;
+    size_t size = matrix_file_size(t.n, DTYPE_INT32);
+    int fits = size <= cache_max();
+
+    // older versions of the same file are stale
+    evict_prefix(prefix);
+    if (fits)
+        make_room(size);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp%d", full, getpid());
+    if (parse_into(&t, tmp, nprocs) == -1) {
+        int saved_errno = errno;
+        text_close(&t);
+        errno = saved_errno;
+        return -1;
+    }
+    text_close(&t);
+
+    // the rename is atomic, other processes see either nothing or all of it
+    if (fits && rename(tmp, full) == 0)
+        return matrix_map(full, m);
+
+    // too large to be cached, use it once
+    int r = matrix_map(tmp, m);
+    unlink(tmp);
+    return r;
+}
+
+int matrix_open(const char *path, int nprocs, struct matrix *m) {
+    if (matrix_map(path, m) == 0)
+        return 0;
+    if (errno != EINVAL)
+        return -1;
+    return cache_load(path, nprocs, m);
+}
@@ -0,0 +1,73 @@
+/**
+ * Cache of parsed text matrices in shared memory.
+ *
+ * A text matrix is parsed once (see `parse.h`) into a file in `/dev/shm`, in
+ * the binary format from `matrix.h`. The name of the file is derived from the
+ * identity of the text file: its absolute path, device, inode, size and
+ * modification time. Later runs find it by name and map it read-only, so
+ * nothing is parsed again until the text file changes.
+ *
+ * The total size of the cache is capped, `CACHE_MAX_BYTES` by default or the
+ * value of the environment variable `Q5_CACHE_MAX`. When a new entry does not
+ * fit, the least recently used entries are evicted.
+ *
+ * An entry is parsed into `<entry>.tmp<pid>` and renamed into place. The
+ * temporary files of processes that died meanwhile are removed whenever
+ * entries are evicted.
+ */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "matrix.h"
+
+#define CACHE_DIR "/dev/shm"
+#define CACHE_PREFIX "q5-cache-"
+#define CACHE_MAX_BYTES (1ul << 30)
+
+/** An entry of the cache, as listed by `cache_list` */
+struct cache_entry {
+    char name[256];   // name of the file in CACHE_DIR
+    size_t size;      // size in bytes
+    time_t last_used; // time of the last lookup that found it
+    size_t n;         // number of rows and columns
+    int dtype;        // type of the elements
+};
+
+/**
+ * @brief Maps a matrix file. Binary files are mapped directly; text files
+ * are looked up in the cache, and parsed with `nprocs` processes and added to
+ * the cache if missing. Parse errors are printed to stderr
+ *
+ * @param path The pathname of the binary or text matrix file
+ * @param nprocs The number of processes used to parse a text file
+ * @param m Output, the mapped matrix
+ * @retval -1 - Error, `errno` is set accordingly. `EINVAL` if the file is
+ * neither a valid binary nor a valid text matrix
+ * @retval 0 - OK
+ */
+int matrix_open(const char *path, int nprocs, struct matrix *m);
+
+/**
+ * @brief Lists the entries of the cache, from the most to the least recently
+ * used
+ *
+ * @param entries Output, array allocated with `malloc`, to be freed by the
+ * caller
+ * @return The number of entries, or -1 on error (`errno` is set accordingly)
+ */
+int cache_list(struct cache_entry **entries);
+
+/**
+ * @brief Evicts the entries of a text file, or every entry, along with the
+ * temporary files left behind by dead processes
+ *
+ * @param path The pathname of the text file, or `NULL` to evict everything
+ * @return The number of entries evicted, or -1 on error (`errno` is set
+ * accordingly)
+ */
+int cache_evict(const char *path);
+
+#endif
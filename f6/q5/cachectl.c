@@ -0,0 +1,58 @@
+/**
+ * Inspects and evicts the cache of parsed text matrices (see `cache.h`).
+ *
+ *   list            lists the entries, most recently used first
+ *   evict <file>    evicts the entries of a text matrix
+ *   clear           evicts every entry
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache.h"
+
+void usage(char *prog) {
+    fprintf(stderr, "Usage: %s list | evict <matrix.txt> | clear\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "list") == 0) {
+        struct cache_entry *entries;
+        int len = cache_list(&entries);
+        if (len == -1) {
+            fprintf(stderr, "Failed to list the cache. Cause: %s\n",
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        static const char *dtypes[] = {"int32", "int16", "uint8"};
+        size_t total = 0;
+        for (int i = 0; i < len; i++) {
+            char when[32];
+            strftime(when, sizeof(when), "%F %T",
+                     localtime(&entries[i].last_used));
+            printf("%s  %10zu  %6zux%-6zu %-5s  %s\n", when, entries[i].size,
+                   entries[i].n, entries[i].n,
+                   entries[i].dtype >= 0 && entries[i].dtype <= DTYPE_UINT8
+                       ? dtypes[entries[i].dtype]
+                       : "?",
+                   entries[i].name);
+            total += entries[i].size;
+        }
+        printf("%d entries, %zu bytes in %s\n", len, total, CACHE_DIR);
+        free(entries);
+    } else if ((argc == 3 && strcmp(argv[1], "evict") == 0) ||
+               (argc == 2 && strcmp(argv[1], "clear") == 0)) {
+        int evicted = cache_evict(argc == 3 ? argv[2] : NULL);
+        if (evicted == -1) {
+            fprintf(stderr, "Failed to evict. Cause: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        printf("%d entries evicted\n", evicted);
+    } else {
+        usage(argv[0]);
+    }
+    return EXIT_SUCCESS;
+}
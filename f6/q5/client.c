@@ -0,0 +1,121 @@
+/**
+ * Client of `server.c`. Sends a reduction query and prints the result. With
+ * `-n`, the query is repeated over the same connection and the average
+ * latency per query is reported as well.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "reduce.h"
+#include "server.h"
+
+/**
+ * @brief Sends a request and reads the response. Exits on failure
+ *
+ * @param fd The connected socket
+ * @param req The request
+ * @param resp Output, the response
+ */
+void query(int fd, const struct request *req, struct response *resp) {
+    if (write(fd, req, sizeof(*req)) != sizeof(*req)) {
+        fprintf(stderr, "Failed to send request. Cause: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    char *p = (char *)resp;
+    size_t left = sizeof(*resp);
+    while (left > 0) {
+        ssize_t bytes = read(fd, p, left);
+        if (bytes <= 0) {
+            fprintf(stderr, "Failed to read response. Cause: %s\n",
+                    bytes == 0 ? "connection closed" : strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        p += bytes;
+        left -= bytes;
+    }
+}
+
+void usage(char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-o op] [-u upper] [-b bins] [-f first] [-l last] "
+            "[-n repeat] <socket> [threshold]\n"
+            "  -o  count (default), sum, min, max, range or hist\n"
+            "  -u  upper bound for range and hist, threshold is the lower\n"
+            "  -b  number of bins for hist (default 10)\n"
+            "  -f  first row (default 0)\n"
+            "  -l  one past the last row (default: all rows)\n"
+            "  -n  number of times to send the query (default 1)\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    /* ------ parse arguments ------ */
+    struct request req = {.q = {.op = OP_COUNT, .bins = 10}};
+    long repeat = 1;
+    int opt; // '+' stops at the first non-option, thresholds can be negative
+    while ((opt = getopt(argc, argv, "+o:u:b:f:l:n:")) != -1) {
+        switch (opt) {
+            case 'o':
+                if ((req.q.op = reduce_op_parse(optarg)) == -1)
+                    usage(argv[0]);
+                break;
+            case 'u':
+                req.q.hi = atol(optarg);
+                break;
+            case 'b':
+                req.q.bins = atoi(optarg);
+                break;
+            case 'f':
+                req.first = atol(optarg);
+                break;
+            case 'l':
+                req.last = atol(optarg);
+                break;
+            case 'n':
+                if ((repeat = atol(optarg)) <= 0)
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1 && argc - optind != 2)
+        usage(argv[0]);
+    char *sock_path = argv[optind];
+    if (argc - optind == 2)
+        req.q.lo = atol(argv[optind + 1]);
+
+    /* ------ connect ------ */
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, sock_path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "Failed to connect to '%s'. Cause: %s\n", sock_path,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* ------ send the queries ------ */
+    struct response resp;
+    double start = reduce_now();
+    for (long i = 0; i < repeat; i++)
+        query(fd, &req, &resp);
+    double elapsed = reduce_now() - start;
+    close(fd);
+
+    if (resp.status != 0) {
+        fprintf(stderr, "Query failed. Cause: %s\n", strerror(resp.status));
+        exit(EXIT_FAILURE);
+    }
+    reduce_print(&req.q, &resp.r);
+    if (repeat > 1)
+        fprintf(stderr, "%ld queries, %.1f us per query\n", repeat,
+                elapsed / repeat * 1e6);
+    return EXIT_SUCCESS;
+}
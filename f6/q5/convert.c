@@ -0,0 +1,91 @@
+/**
+ * Converts a matrix in the text format used by `original.c` (first line is the
+ * size `n`, followed by `n` lines with `n` integers each) to the binary format
+ * described in `matrix.h`.
+ *
+ * Elements are stored as int32 by default. Smaller types (`-t int16` or
+ * `-t uint8`) fit more values per cache line and SIMD register.
+ *
+ * The text is parsed in parallel by `nprocs` processes (see `parse.h`), one
+ * per online CPU by default.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "matrix.h"
+#include "parse.h"
+
+void usage(char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-t int32|int16|uint8] [-j nprocs] <matrix.txt> "
+            "<matrix.bin>\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    /* validate arguments */
+    int dtype = DTYPE_INT32;
+    int nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while ((opt = getopt(argc, argv, "t:j:")) != -1) {
+        switch (opt) {
+            case 't':
+                if ((dtype = dtype_parse(optarg)) == -1)
+                    usage(argv[0]);
+                break;
+            case 'j':
+                if ((nprocs = atoi(optarg)) <= 0)
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2)
+        usage(argv[0]);
+    char *infile = argv[optind], *outfile = argv[optind + 1];
+
+    /* map the text file and read the matrix size */
+    struct text t;
+    if (text_open(infile, &t) == -1) {
+        fprintf(stderr, "Failed to open matrix '%s'. Cause: %s\n", infile,
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    struct matrix m;
+    if (matrix_create(outfile, t.n, dtype, &m) == -1) {
+        fprintf(stderr, "Failed to create '%s'. Cause: %s\n", outfile,
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* parse the rows directly into the mapping of the output file */
+    struct parse_error *errors =
+        malloc((nprocs * PARSE_MAX_ERRORS + 1) * sizeof(struct parse_error));
+    if (errors == NULL) {
+        fprintf(stderr, "Failed to allocate memory for errors\n");
+        return EXIT_FAILURE;
+    }
+    int nerrors = text_parse(&t, &m, nprocs, errors);
+    if (nerrors == -1) {
+        fprintf(stderr, "Failed to parse '%s'. Cause: %s\n", infile,
+                strerror(errno));
+    }
+    for (int i = 0; i < nerrors; i++)
+        fprintf(stderr, "Row %zu: %s\n", errors[i].row, errors[i].msg);
+
+    free(errors);
+    text_close(&t);
+    matrix_unmap(&m);
+    if (nerrors != 0) {
+        // do not leave a half converted matrix behind
+        unlink(outfile);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
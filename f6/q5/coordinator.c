@@ -0,0 +1,338 @@
+/**
+ * Multi-node version of `counter.c`. The rows of the matrix are scattered to
+ * nodes (see `node.c`) listening on UNIX sockets, which stand in for remote
+ * machines: they share nothing with the coordinator but the pathname of the
+ * matrix file. The partial results are gathered and merged here.
+ *
+ * The rows are split into more ranges than nodes, and each node is given a
+ * new range as soon as it returns the previous one, so faster nodes take more
+ * of them. A node that fails (closes the connection or returns an error) is
+ * dropped and its range is given to another node. A node that takes longer
+ * than the timeout is kept, but its range is also given to another node, and
+ * whichever answers first is used.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "matrix.h"
+#include "node.h"
+#include "reduce.h"
+
+/** A range of rows */
+struct range {
+    size_t first, last;
+    int done;     // its result was merged
+    int inflight; // number of nodes working on it
+    int late;     // a node timed out on it, may be given to a second one
+};
+
+/** A node, and the range it is working on */
+struct node {
+    const char *path; // pathname of its socket
+    int fd;           // -1 if it failed
+    int range;        // -1 if idle
+    double deadline;  // when the range is given to another node as well
+    int ranges, failures, timeouts; // statistics
+};
+
+/**
+ * @brief Connects to a node
+ *
+ * @return The connected socket, or -1 on error
+ */
+int node_connect(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd != -1 &&
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Drops a failed node. Its range, if any, goes back to the others
+ *
+ * @param node The node
+ * @param ranges The ranges
+ * @param why The cause of the failure
+ */
+void node_fail(struct node *node, struct range *ranges, const char *why) {
+    fprintf(stderr, "Node '%s' failed. Cause: %s\n", node->path, why);
+    if (node->range != -1)
+        ranges[node->range].inflight--;
+    node->range = -1;
+    node->failures++;
+    close(node->fd);
+    node->fd = -1;
+}
+
+/**
+ * @brief Picks the next range to be given to an idle node: first one that no
+ * node is working on, otherwise a late one that only one node is working on
+ *
+ * @return The index of the range, or -1 if there is none
+ */
+int next_range(const struct range *ranges, int nranges) {
+    for (int i = 0; i < nranges; i++)
+        if (!ranges[i].done && ranges[i].inflight == 0)
+            return i;
+    for (int i = 0; i < nranges; i++)
+        if (!ranges[i].done && ranges[i].late && ranges[i].inflight == 1)
+            return i;
+    return -1;
+}
+
+/**
+ * @brief Reads a response from a node, which is known to be readable
+ *
+ * @return 1 if read, 0 if the node closed the connection, -1 on error
+ */
+int read_response(int fd, struct response *resp) {
+    char *p = (char *)resp;
+    size_t left = sizeof(*resp);
+    while (left > 0) {
+        ssize_t bytes = read(fd, p, left);
+        if (bytes <= 0)
+            return bytes;
+        p += bytes;
+        left -= bytes;
+    }
+    return 1;
+}
+
+void usage(char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-o op] [-u upper] [-b bins] [-r ranges] [-w timeout_ms] "
+            "<matrix.bin> <threshold> <socket>...\n"
+            "  -o  count (default), sum, min, max, range or hist\n"
+            "  -u  upper bound for range and hist, threshold is the lower\n"
+            "  -b  number of bins for hist (default 10)\n"
+            "  -r  number of ranges of rows (default: 4 per node)\n"
+            "  -w  time before the range of a slow node is given to another "
+            "one (default 1000)\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    /* ------ parse arguments ------ */
+    struct reduce_query q = {.op = OP_COUNT, .lo = 0, .hi = 0, .bins = 10};
+    int nranges = 0;
+    long timeout_ms = 1000;
+    int opt; // '+' stops at the first non-option, thresholds can be negative
+    while ((opt = getopt(argc, argv, "+o:u:b:r:w:")) != -1) {
+        switch (opt) {
+            case 'o':
+                if ((q.op = reduce_op_parse(optarg)) == -1)
+                    usage(argv[0]);
+                break;
+            case 'u':
+                q.hi = atol(optarg);
+                break;
+            case 'b':
+                q.bins = atoi(optarg);
+                break;
+            case 'r':
+                if ((nranges = atoi(optarg)) <= 0)
+                    usage(argv[0]);
+                break;
+            case 'w':
+                if ((timeout_ms = atol(optarg)) <= 0)
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (argc - optind < 3)
+        usage(argv[0]);
+    char *infile = argv[optind];
+    q.lo = atol(argv[optind + 1]);
+    if (q.op == OP_HIST &&
+        (q.bins <= 0 || q.bins > HIST_MAX_BINS || q.hi < q.lo)) {
+        fprintf(stderr, "hist needs 1 to %d bins and upper >= threshold\n",
+                HIST_MAX_BINS);
+        exit(EXIT_FAILURE);
+    }
+    int nnodes = argc - optind - 2;
+    char **sockets = &argv[optind + 2];
+
+    /* ------ read the size of the matrix ------ */
+    // the nodes may run in another directory, send them an absolute path
+    struct shard_request req = {.q = q};
+    char abs[PATH_MAX];
+    struct matrix m;
+    if (realpath(infile, abs) == NULL || matrix_map(abs, &m) == -1) {
+        fprintf(stderr, "Failed to map '%s'. Cause: %s\n", infile,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (strlen(abs) >= NODE_PATH_MAX) {
+        fprintf(stderr, "Path '%s' is too long\n", abs);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(req.path, abs);
+    size_t n = m.n;
+    matrix_unmap(&m); // the nodes read the rows, not the coordinator
+
+    /* ------ split the rows ------ */
+    if (nranges == 0)
+        nranges = 4 * nnodes;
+    if ((size_t)nranges > n)
+        nranges = n > 0 ? n : 1;
+    struct range *ranges = calloc(nranges, sizeof(*ranges));
+    struct node *nodes = calloc(nnodes, sizeof(*nodes));
+    if (ranges == NULL || nodes == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < nranges; i++) {
+        ranges[i].first = n * i / nranges;
+        ranges[i].last = n * (i + 1) / nranges;
+    }
+
+    /* ------ connect to the nodes ------ */
+    signal(SIGPIPE, SIG_IGN);
+    for (int i = 0; i < nnodes; i++) {
+        nodes[i].path = sockets[i];
+        nodes[i].range = -1;
+        if ((nodes[i].fd = node_connect(sockets[i])) == -1) {
+            fprintf(stderr, "Failed to connect to '%s'. Cause: %s\n",
+                    sockets[i], strerror(errno));
+            nodes[i].failures++;
+        }
+    }
+
+    /* ------ scatter the ranges and gather the results ------ */
+    struct reduce_result r;
+    reduce_init(&q, &r);
+    struct pollfd *fds = malloc(nnodes * sizeof(*fds));
+    int *polled = malloc(nnodes * sizeof(*polled));
+    int remaining = nranges, duplicates = 0;
+    double start = reduce_now();
+    while (remaining > 0) {
+        // give a range to each idle node
+        for (int i = 0; i < nnodes; i++) {
+            struct node *node = &nodes[i];
+            if (node->fd == -1 || node->range != -1)
+                continue;
+            int k = next_range(ranges, nranges);
+            if (k == -1)
+                break;
+            req.first = ranges[k].first;
+            req.last = ranges[k].last;
+            node->range = k;
+            ranges[k].inflight++;
+            if (write(node->fd, &req, sizeof(req)) != sizeof(req)) {
+                node_fail(node, ranges, strerror(errno)); // range goes back
+                continue;
+            }
+            node->deadline = reduce_now() + timeout_ms / 1e3;
+        }
+
+        // wait for a response, or for the next deadline
+        int nfds = 0;
+        double next_deadline = -1;
+        for (int i = 0; i < nnodes; i++) {
+            if (nodes[i].range == -1)
+                continue;
+            fds[nfds] = (struct pollfd){.fd = nodes[i].fd, .events = POLLIN};
+            polled[nfds++] = i;
+            if (!ranges[nodes[i].range].late &&
+                (next_deadline < 0 || nodes[i].deadline < next_deadline))
+                next_deadline = nodes[i].deadline;
+        }
+        if (nfds == 0) {
+            fprintf(stderr, "All nodes failed, %d of %d ranges left\n",
+                    remaining, nranges);
+            exit(EXIT_FAILURE);
+        }
+        int wait_ms = -1;
+        if (next_deadline >= 0) {
+            double left = next_deadline - reduce_now();
+            wait_ms = left > 0 ? (int)(left * 1e3) + 1 : 0;
+        }
+        if (poll(fds, nfds, wait_ms) == -1) {
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int j = 0; j < nfds; j++) {
+            struct node *node = &nodes[polled[j]];
+            if (fds[j].revents == 0)
+                continue;
+            struct response resp;
+            int status = read_response(node->fd, &resp);
+            if (status != 1) {
+                node_fail(node, ranges,
+                          status == 0 ? "connection closed" : strerror(errno));
+                continue;
+            }
+            // a request every node rejects, dropping them would not help
+            if (resp.status == EINVAL) {
+                fprintf(stderr, "Node '%s' rejected the query. Cause: %s\n",
+                        node->path, strerror(resp.status));
+                exit(EXIT_FAILURE);
+            }
+            if (resp.status != 0) {
+                node_fail(node, ranges, strerror(resp.status));
+                continue;
+            }
+            struct range *range = &ranges[node->range];
+            range->inflight--;
+            node->range = -1;
+            node->ranges++;
+            if (range->done) { // a second node answered first
+                duplicates++;
+                continue;
+            }
+            range->done = 1;
+            remaining--;
+            reduce_merge(&q, &r, &resp.r);
+        }
+
+        // give the ranges of late nodes to another node as well
+        double t = reduce_now();
+        for (int i = 0; i < nnodes; i++) {
+            struct node *node = &nodes[i];
+            if (node->range != -1 && !ranges[node->range].late &&
+                t >= node->deadline) {
+                ranges[node->range].late = 1;
+                node->timeouts++;
+                fprintf(stderr, "Node '%s' is late on rows [%zu, %zu)\n",
+                        node->path, ranges[node->range].first,
+                        ranges[node->range].last);
+            }
+        }
+    }
+    double elapsed = reduce_now() - start;
+
+    /* ------ print the result and the statistics ------ */
+    reduce_print(&q, &r);
+    fprintf(stderr, "%d ranges in %.3f s, %d duplicate results\n", nranges,
+            elapsed, duplicates);
+    fprintf(stderr, "%-24s %8s %8s %8s\n", "node", "ranges", "failures",
+            "late");
+    for (int i = 0; i < nnodes; i++) {
+        fprintf(stderr, "%-24s %8d %8d %8d\n", nodes[i].path, nodes[i].ranges,
+                nodes[i].failures, nodes[i].timeouts);
+        if (nodes[i].fd != -1)
+            close(nodes[i].fd);
+    }
+    free(fds);
+    free(polled);
+    free(nodes);
+    free(ranges);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+/**
+ * Same as `original.c`, counts how many values of a matrix are above a
+ * threshold using `nprocs` processes, but reads the binary format from
+ * `matrix.h` (see `convert.c`).
+ *
+ * The matrix file is mapped with `mmap` instead of being parsed into the
+ * stack. The mapping is shared, so the forked workers read the same page cache
+ * pages and nothing is copied, regardless of the size of the matrix.
+ *
+ * A text matrix can be given as well. It is parsed once into the cache from
+ * `cache.h` and mapped from there on later runs.
+ *
+ * Besides counting, any reduction from `reduce.h` can be selected, as well as
+ * the way rows are split between the workers. With `-s`, the reduction is run
+ * with 1, 2, ..., nprocs workers and the scaling efficiency is reported.
+ *
+ * With `-t`, the workers are the threads of a work-stealing pool instead of
+ * forked processes, and balance the rows between themselves (the partition
+ * does not apply). `-x factor` makes the first eighth of the rows `factor`
+ * times as costly, to compare how the backends cope with uneven work.
+ *
+ * `-a policy` pins the workers, threads or processes, with a policy of
+ * `f7/lib/placement.h` (compact, scatter, node), so that runs are
+ * comparable. Worker processes pin themselves before reading any row, so
+ * rows that are not in the page cache yet are read into their node.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../../f7/lib/placement.h"
+#include "cache.h"
+#include "kernel.h"
+#include "matrix.h"
+#include "reduce.h"
+
+/**
+ * @brief Runs the reduction once and returns the elapsed time. Exits on
+ * failure
+ *
+ * @param m The matrix
+ * @param q The query
+ * @param nprocs The number of worker processes
+ * @param partition The partitioning scheme, -1 for the thread pool
+ * @param r Output, the result of the reduction
+ * @return The elapsed wall clock time, in seconds
+ */
+double timed_run(const struct matrix *m, const struct reduce_query *q,
+                 int nprocs, int partition, struct reduce_result *r) {
+    double start = reduce_now();
+    int ret = partition == -1 ? reduce_run_threads(m, q, nprocs, r)
+                              : reduce_run(m, q, nprocs, partition, r);
+    if (ret == -1) {
+        fprintf(stderr, "Reduction failed. Cause: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return reduce_now() - start;
+}
+
+void usage(char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-o op] [-p partition] [-u upper] [-b bins] [-k kernel] "
+            "[-s] [-t] [-x factor] [-a policy] "
+            "<matrix.bin|matrix.txt> <nprocs> [threshold]\n"
+            "  -o  count (default), sum, min, max, range or hist\n"
+            "  -p  block, cyclic (default) or dynamic\n"
+            "  -u  upper bound for range and hist, threshold is the lower\n"
+            "  -b  number of bins for hist (default 10)\n"
+            "  -k  avx512, avx2 or scalar (default: best supported)\n"
+            "  -s  report scaling efficiency from 1 to nprocs workers\n"
+            "  -t  nprocs threads of a work-stealing pool instead of processes\n"
+            "  -x  the first eighth of the rows is factor times as costly\n"
+            "  -a  pin the workers: none (default), compact, scatter or node\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    /* ------ parse arguments ------ */
+    struct reduce_query q = {.op = OP_COUNT, .lo = 0, .hi = 0, .bins = 10};
+    int partition = PART_CYCLIC;
+    int scaling = 0, threads = 0, policy = PLACE_NONE;
+    int opt; // '+' stops at the first non-option, thresholds can be negative
+    while ((opt = getopt(argc, argv, "+o:p:u:b:k:stx:a:")) != -1) {
+        switch (opt) {
+            case 'o':
+                if ((q.op = reduce_op_parse(optarg)) == -1)
+                    usage(argv[0]);
+                break;
+            case 'p':
+                if ((partition = partition_parse(optarg)) == -1)
+                    usage(argv[0]);
+                break;
+            case 'u':
+                q.hi = atol(optarg);
+                break;
+            case 'b':
+                q.bins = atoi(optarg);
+                break;
+            case 'k':
+                if (kernel_select(optarg) == -1) {
+                    fprintf(stderr, "Kernel '%s' is not supported\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 's':
+                scaling = 1;
+                break;
+            case 't':
+                threads = 1;
+                break;
+            case 'x':
+                reduce_set_skew(atoi(optarg));
+                break;
+            case 'a':
+                if ((policy = placement_parse(optarg)) == -1)
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2 && argc - optind != 3)
+        usage(argv[0]);
+    char *infile = argv[optind];
+    int nprocs = atoi(argv[optind + 1]);
+    if (argc - optind == 3)
+        q.lo = atol(argv[optind + 2]);
+    if (nprocs <= 0) {
+        fprintf(stderr, "The number of processes must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (threads)
+        partition = -1;
+    if (policy != PLACE_NONE) {
+        if (placement_set(policy) == -1) {
+            fprintf(stderr, "Failed to read the topology. Cause: %s\n",
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        // the pool pins its own threads, the caller is its worker 0
+        if (threads)
+            placement_apply(0);
+        else
+            reduce_set_placement(placement_apply);
+    }
+
+    /* ------ map matrix ------ */
+    struct matrix m;
+    if (matrix_open(infile, nprocs, &m) == -1) {
+        fprintf(stderr, "Failed to map '%s'. Cause: %s\n", infile,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    // rows are read sequentially, ask for aggressive read-ahead
+    madvise(m.map, m.size, MADV_SEQUENTIAL);
+
+    /* ------ run reduction ------ */
+    struct reduce_result r;
+    if (!scaling) {
+        timed_run(&m, &q, nprocs, partition, &r);
+        reduce_print(&q, &r);
+        // stdout is only the result, for scripts
+        if (policy != PLACE_NONE)
+            fprintf(stderr, "placement %s\n", placement_name(policy));
+    } else {
+        // warm up the page cache, so that the 1 worker run is not penalized
+        timed_run(&m, &q, nprocs, partition, &r);
+        reduce_print(&q, &r);
+
+        printf("kernel %s, %.1f MB, placement %s\n", kernel_name(),
+               m.n * m.stride / 1e6, placement_name(policy));
+        printf("workers time_s speedup efficiency\n");
+        double base = 0;
+        for (int p = 1; p <= nprocs; p++) {
+            double t = timed_run(&m, &q, p, partition, &r);
+            if (p == 1)
+                base = t;
+            printf("%d %.6f %.2f %.2f\n", p, t, base / t, base / (t * p));
+        }
+    }
+
+    matrix_unmap(&m);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,306 @@
+#include "index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** A distinct value and the number of times it occurs */
+struct entry {
+    int64_t value;
+    uint64_t count;
+};
+
+/** Open addressing hash table, for int32 matrices */
+struct table {
+    struct entry *slots; // value INT64_MIN marks an empty slot
+    size_t cap;          // power of 2
+    size_t len;
+};
+
+#define EMPTY INT64_MIN
+
+int index_path(const char *matrix_path, char *buf, size_t len) {
+    int r = snprintf(buf, len, "%s.idx", matrix_path);
+    return r < 0 || (size_t)r >= len ? -1 : 0;
+}
+
+static int table_init(struct table *t, size_t cap) {
+    t->slots = malloc(cap * sizeof(struct entry));
+    if (t->slots == NULL)
+        return -1;
+    for (size_t i = 0; i < cap; i++)
+        t->slots[i].value = EMPTY;
+    t->cap = cap;
+    t->len = 0;
+    return 0;
+}
+
+/** Fibonacci hashing, spreads consecutive values over the table */
+static inline size_t table_hash(const struct table *t, int64_t value) {
+    return ((uint64_t)value * 0x9E3779B97F4A7C15ull) >> 32 & (t->cap - 1);
+}
+
+/**
+ * @brief Adds `count` occurrences of a value, growing the table when it is
+ * half full
+ */
+static int table_add(struct table *t, int64_t value, uint64_t count) {
+    if (2 * (t->len + 1) > t->cap) {
+        struct table bigger;
+        if (t->len + 1 > INDEX_MAX_DISTINCT) {
+            errno = E2BIG;
+            return -1;
+        }
+        if (table_init(&bigger, 2 * t->cap) == -1)
+            return -1;
+        for (size_t i = 0; i < t->cap; i++)
+            if (t->slots[i].value != EMPTY)
+                table_add(&bigger, t->slots[i].value, t->slots[i].count);
+        free(t->slots);
+        *t = bigger;
+    }
+
+    size_t i = table_hash(t, value);
+    while (t->slots[i].value != EMPTY && t->slots[i].value != value)
+        i = (i + 1) & (t->cap - 1);
+    if (t->slots[i].value == EMPTY) {
+        t->slots[i].value = value;
+        t->slots[i].count = 0;
+        t->len++;
+    }
+    t->slots[i].count += count;
+    return 0;
+}
+
+static int cmp_entries(const void *a, const void *b) {
+    const struct entry *x = a, *y = b;
+    return (x->value > y->value) - (x->value < y->value);
+}
+
+/**
+ * @brief Counts the occurrences of each value of the matrix
+ *
+ * @param m The matrix
+ * @param t Output, table with an entry per distinct value
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+static int count_values(const struct matrix *m, struct table *t) {
+    if (m->dtype == DTYPE_INT32) {
+        if (table_init(t, 1024) == -1)
+            return -1;
+        for (size_t i = 0; i < m->n; i++) {
+            const int32_t *row = matrix_row(m, i);
+            for (size_t j = 0; j < m->n; j++) {
+                if (table_add(t, row[j], 1) == -1) {
+                    free(t->slots);
+                    return -1;
+                }
+            }
+        }
+        return 0;
+    }
+
+    // small types, count with a plain array indexed by value
+    size_t range = m->dtype == DTYPE_INT16 ? 1 << 16 : 1 << 8;
+    long base = m->dtype == DTYPE_INT16 ? INT16_MIN : 0;
+    uint64_t *counts = calloc(range, sizeof(uint64_t));
+    if (counts == NULL)
+        return -1;
+    for (size_t i = 0; i < m->n; i++) {
+        const void *row = matrix_row(m, i);
+        if (m->dtype == DTYPE_INT16)
+            for (size_t j = 0; j < m->n; j++)
+                counts[((const int16_t *)row)[j] - base]++;
+        else
+            for (size_t j = 0; j < m->n; j++)
+                counts[((const uint8_t *)row)[j]]++;
+    }
+    if (table_init(t, 2 * range) == -1) {
+        free(counts);
+        return -1;
+    }
+    for (size_t v = 0; v < range; v++)
+        if (counts[v] > 0)
+            table_add(t, (long)v + base, counts[v]);
+    free(counts);
+    return 0;
+}
+
+/**
+ * @brief Writes the whole buffer, retrying on short writes
+ */
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t bytes = write(fd, p, len);
+        if (bytes == -1)
+            return -1;
+        p += bytes;
+        len -= bytes;
+    }
+    return 0;
+}
+
+int index_build(const char *matrix_path, const struct matrix *m) {
+    char path[4096], tmp[4096 + 8];
+    if (index_path(matrix_path, path, sizeof(path)) == -1) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    /* ------ count each distinct value, then sort them ------ */
+    struct table t;
+    size_t distinct = 0;
+    int unindexed = 0;
+    if (count_values(m, &t) == -1) {
+        if (errno != E2BIG)
+            return -1;
+        // recorded, so that the next runs do not count them again
+        unindexed = 1;
+        t.slots = NULL;
+        t.cap = 0;
+    }
+    for (size_t i = 0; i < t.cap; i++)
+        if (t.slots[i].value != EMPTY)
+            t.slots[distinct++] = t.slots[i];
+    qsort(t.slots, distinct, sizeof(struct entry), cmp_entries);
+
+    // + 1, so that no values is not mistaken for a failure
+    int32_t *values = malloc(distinct * sizeof(int32_t) + 1);
+    uint64_t *ge = malloc(distinct * sizeof(uint64_t) + 1);
+    if (values == NULL || ge == NULL) {
+        free(values);
+        free(ge);
+        free(t.slots);
+        return -1;
+    }
+    // suffix sums, from the largest value down
+    uint64_t acc = 0;
+    for (size_t i = distinct; i-- > 0;) {
+        acc += t.slots[i].count;
+        values[i] = t.slots[i].value;
+        ge[i] = acc;
+    }
+    free(t.slots);
+
+    /* ------ write to a temporary file and rename it over the index ------ */
+    // the identity of the mapped file, which the path may no longer name
+    struct index_header hdr = {0};
+    memcpy(hdr.magic, INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = INDEX_VERSION;
+    hdr.dtype = m->dtype;
+    hdr.dev = m->dev;
+    hdr.ino = m->ino;
+    hdr.size = m->size;
+    hdr.mtime_sec = m->mtime_sec;
+    hdr.mtime_nsec = m->mtime_nsec;
+    hdr.n = m->n;
+    hdr.distinct = distinct;
+    hdr.flags = unindexed ? INDEX_UNINDEXED : 0;
+
+    int r = -1;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd != -1) {
+        // values are padded to 8 bytes, so that 'ge' is aligned
+        uint32_t pad = 0;
+        if (write_all(fd, &hdr, sizeof(hdr)) == 0 &&
+            write_all(fd, values, distinct * sizeof(int32_t)) == 0 &&
+            write_all(fd, &pad, (distinct % 2) * sizeof(pad)) == 0 &&
+            write_all(fd, ge, distinct * sizeof(uint64_t)) == 0 &&
+            close(fd) == 0 && rename(tmp, path) == 0)
+            r = 0;
+        else
+            unlink(tmp);
+    }
+    free(values);
+    free(ge);
+    if (r == 0 && unindexed) {
+        errno = E2BIG;
+        return -1;
+    }
+    return r;
+}
+
+int index_map(const char *matrix_path, const struct matrix *m,
+              struct index *idx) {
+    char path[4096];
+    if (index_path(matrix_path, path, sizeof(path)) == -1) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(struct index_header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    const struct index_header *hdr = map;
+    size_t values_size = (hdr->distinct + hdr->distinct % 2) * sizeof(int32_t);
+    if (memcmp(hdr->magic, INDEX_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != INDEX_VERSION || hdr->distinct > INDEX_MAX_DISTINCT ||
+        (hdr->flags & ~(uint64_t)INDEX_UNINDEXED) != 0 ||
+        ((hdr->flags & INDEX_UNINDEXED) && hdr->distinct != 0) ||
+        sizeof(*hdr) + values_size + hdr->distinct * sizeof(uint64_t) !=
+            (size_t)st.st_size) {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+    // the matrix file was replaced or modified after the index was built
+    if (hdr->dev != m->dev || hdr->ino != m->ino || hdr->size != m->size ||
+        hdr->mtime_sec != m->mtime_sec || hdr->mtime_nsec != m->mtime_nsec) {
+        munmap(map, st.st_size);
+        errno = ESTALE;
+        return -1;
+    }
+    if (hdr->flags & INDEX_UNINDEXED) {
+        munmap(map, st.st_size);
+        errno = E2BIG;
+        return -1;
+    }
+
+    idx->distinct = hdr->distinct;
+    idx->values = (const int32_t *)(hdr + 1);
+    idx->ge = (const uint64_t *)((const char *)(hdr + 1) + values_size);
+    idx->map = map;
+    idx->size = st.st_size;
+    return 0;
+}
+
+void index_unmap(struct index *idx) {
+    munmap(idx->map, idx->size);
+    idx->map = NULL;
+}
+
+uint64_t index_count_above(const struct index *idx, long threshold) {
+    // find the first value greater than the threshold
+    size_t lo = 0, hi = idx->distinct;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->values[mid] <= threshold)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < idx->distinct ? idx->ge[lo] : 0;
+}
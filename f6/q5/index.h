@@ -0,0 +1,111 @@
+/**
+ * Index for repeated threshold queries against the same matrix.
+ *
+ * The index holds the distinct values of the matrix, sorted, and for each one
+ * how many elements are greater than or equal to it. So, the number of
+ * elements above any threshold is found with a binary search, in
+ * O(log distinct), without touching the matrix.
+ *
+ * It is stored next to the matrix file (`<matrix>.idx`) together with the
+ * identity of the matrix file (device, inode, size and modification time).
+ * An index whose identity does not match the matrix file is stale.
+ *
+ * A matrix with more than `INDEX_MAX_DISTINCT` distinct values is not
+ * indexed, but the index file records it (`INDEX_UNINDEXED`), so that the
+ * values are not counted again until the matrix changes.
+ */
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "matrix.h"
+
+#define INDEX_MAGIC "SOMINDEX"
+#define INDEX_VERSION 2
+/** Matrices with more distinct values than this are not indexed */
+#define INDEX_MAX_DISTINCT (UINT64_C(1) << 24)
+/** Flag of an index that records that the matrix has too many values */
+#define INDEX_UNINDEXED 1
+
+/** On-disk header, followed by `values` and then by `ge`, unless
+ * `INDEX_UNINDEXED` is set */
+struct index_header {
+    char magic[8];       // INDEX_MAGIC, not null terminated
+    uint32_t version;    // INDEX_VERSION
+    uint32_t dtype;      // type of the matrix elements
+    uint64_t dev, ino;   // identity of the matrix file
+    uint64_t size;       // size of the matrix file
+    int64_t mtime_sec;   // modification time of the matrix file
+    int64_t mtime_nsec;
+    uint64_t n;          // number of rows and columns of the matrix
+    uint64_t distinct;   // number of distinct values
+    uint64_t flags;      // INDEX_UNINDEXED or 0
+};
+
+/** An index mapped in memory */
+struct index {
+    size_t distinct;      // number of distinct values
+    const int32_t *values; // distinct values, in ascending order
+    const uint64_t *ge;    // ge[i], number of elements >= values[i]
+    void *map;
+    size_t size;
+};
+
+/**
+ * @brief Pathname of the index of a matrix file, i.e., `<matrix>.idx`
+ *
+ * @param matrix_path The pathname of the matrix file
+ * @param buf Output buffer
+ * @param len Size of `buf`
+ * @retval -1 - `buf` is too small
+ * @retval 0 - OK
+ */
+int index_path(const char *matrix_path, char *buf, size_t len);
+
+/**
+ * @brief Builds the index of a matrix and writes it to `<matrix>.idx`. The
+ * file is replaced atomically
+ *
+ * @param matrix_path The pathname of the matrix file
+ * @param m The matrix, mapped from `matrix_path`
+ * @retval -1 - Error, `errno` is set accordingly. `E2BIG` if the matrix has
+ * more than `INDEX_MAX_DISTINCT` distinct values, which the index file then
+ * records
+ * @retval 0 - OK
+ */
+int index_build(const char *matrix_path, const struct matrix *m);
+
+/**
+ * @brief Maps the index of a matrix file
+ *
+ * @param matrix_path The pathname of the matrix file
+ * @param m The matrix, mapped from `matrix_path`, the index must match it
+ * @param idx Output, the mapped index
+ * @retval -1 - Error, `errno` is set accordingly. `ENOENT` if there is no
+ * index, `ESTALE` if the matrix file changed since the index was built, and
+ * `E2BIG` if the matrix has too many distinct values to be indexed
+ * @retval 0 - OK
+ */
+int index_map(const char *matrix_path, const struct matrix *m,
+              struct index *idx);
+
+/**
+ * @brief Unmaps an index mapped with `index_map`
+ *
+ * @param idx The index
+ */
+void index_unmap(struct index *idx);
+
+/**
+ * @brief Number of elements greater than `threshold`, in O(log distinct)
+ *
+ * @param idx The index
+ * @param threshold The threshold
+ * @return The number of elements greater than `threshold`
+ */
+uint64_t index_count_above(const struct index *idx, long threshold);
+
+#endif
@@ -0,0 +1,233 @@
+#include "kernel.h"
+
+#include <immintrin.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "matrix.h"
+
+/** Counts the elements of a row greater than a threshold, which fits dtype */
+typedef size_t (*count_fn)(const void *row, size_t n, long threshold);
+
+/* ------ scalar ------ */
+
+static size_t count_int32_scalar(const void *row, size_t n, long t) {
+    const int32_t *p = row;
+    size_t count = 0;
+    for (size_t k = 0; k < n; k++)
+        count += p[k] > t;
+    return count;
+}
+
+static size_t count_int16_scalar(const void *row, size_t n, long t) {
+    const int16_t *p = row;
+    size_t count = 0;
+    for (size_t k = 0; k < n; k++)
+        count += p[k] > t;
+    return count;
+}
+
+static size_t count_uint8_scalar(const void *row, size_t n, long t) {
+    const uint8_t *p = row;
+    size_t count = 0;
+    for (size_t k = 0; k < n; k++)
+        count += p[k] > t;
+    return count;
+}
+
+/*
+ * ------ AVX2 ------
+ * Compare 32 bytes at a time, turn the comparison into a bitmask with
+ * movemask and count the set bits. The tail of the row (less than a full
+ * vector) is handled by the scalar kernels.
+ */
+
+__attribute__((target("avx2,popcnt"))) static size_t
+count_int32_avx2(const void *row, size_t n, long t) {
+    const int32_t *p = row;
+    __m256i thr = _mm256_set1_epi32(t);
+    size_t count = 0, k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256i gt = _mm256_cmpgt_epi32(
+            _mm256_loadu_si256((const __m256i *)(p + k)), thr);
+        // one bit per 32-bit lane
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(gt)));
+    }
+    return count + count_int32_scalar(p + k, n - k, t);
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t
+count_int16_avx2(const void *row, size_t n, long t) {
+    const int16_t *p = row;
+    __m256i thr = _mm256_set1_epi16(t);
+    size_t count = 0, k = 0;
+    for (; k + 16 <= n; k += 16) {
+        __m256i gt = _mm256_cmpgt_epi16(
+            _mm256_loadu_si256((const __m256i *)(p + k)), thr);
+        // movemask works on bytes, so there are two bits per 16-bit lane
+        count += __builtin_popcount(_mm256_movemask_epi8(gt)) / 2;
+    }
+    return count + count_int16_scalar(p + k, n - k, t);
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t
+count_uint8_avx2(const void *row, size_t n, long t) {
+    const uint8_t *p = row;
+    // AVX2 only has signed compares, flip the sign bit of both operands
+    __m256i bias = _mm256_set1_epi8((char)0x80);
+    __m256i thr = _mm256_xor_si256(_mm256_set1_epi8((char)t), bias);
+    size_t count = 0, k = 0;
+    for (; k + 32 <= n; k += 32) {
+        __m256i v = _mm256_xor_si256(
+            _mm256_loadu_si256((const __m256i *)(p + k)), bias);
+        count += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, thr)));
+    }
+    return count + count_uint8_scalar(p + k, n - k, t);
+}
+
+/*
+ * ------ AVX-512 ------
+ * Compares write straight to a mask register. The tail is handled with a
+ * masked load and compare, so the row is never read past its end.
+ */
+
+__attribute__((target("avx512f,popcnt"))) static size_t
+count_int32_avx512(const void *row, size_t n, long t) {
+    const int32_t *p = row;
+    __m512i thr = _mm512_set1_epi32(t);
+    size_t count = 0, k = 0;
+    for (; k + 16 <= n; k += 16)
+        count += __builtin_popcount(
+            _mm512_cmpgt_epi32_mask(_mm512_loadu_si512(p + k), thr));
+    if (k < n) {
+        __mmask16 tail = (1u << (n - k)) - 1;
+        __m512i v = _mm512_maskz_loadu_epi32(tail, p + k);
+        count += __builtin_popcount(_mm512_mask_cmpgt_epi32_mask(tail, v, thr));
+    }
+    return count;
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt"))) static size_t
+count_int16_avx512(const void *row, size_t n, long t) {
+    const int16_t *p = row;
+    __m512i thr = _mm512_set1_epi16(t);
+    size_t count = 0, k = 0;
+    for (; k + 32 <= n; k += 32)
+        count += __builtin_popcount(
+            _mm512_cmpgt_epi16_mask(_mm512_loadu_si512(p + k), thr));
+    if (k < n) {
+        __mmask32 tail = (1u << (n - k)) - 1;
+        __m512i v = _mm512_maskz_loadu_epi16(tail, p + k);
+        count += __builtin_popcount(_mm512_mask_cmpgt_epi16_mask(tail, v, thr));
+    }
+    return count;
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt"))) static size_t
+count_uint8_avx512(const void *row, size_t n, long t) {
+    const uint8_t *p = row;
+    __m512i thr = _mm512_set1_epi8((char)t);
+    size_t count = 0, k = 0;
+    for (; k + 64 <= n; k += 64)
+        count += __builtin_popcountll(
+            _mm512_cmpgt_epu8_mask(_mm512_loadu_si512(p + k), thr));
+    if (k < n) {
+        __mmask64 tail = (1ull << (n - k)) - 1;
+        __m512i v = _mm512_maskz_loadu_epi8(tail, p + k);
+        count += __builtin_popcountll(_mm512_mask_cmpgt_epu8_mask(tail, v, thr));
+    }
+    return count;
+}
+
+/* ------ dispatch ------ */
+
+static int has_avx512(void) {
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512bw");
+}
+
+static int has_avx2(void) { return __builtin_cpu_supports("avx2"); }
+
+static int has_scalar(void) { return 1; }
+
+/** A set of kernels, one per `enum matrix_dtype` */
+struct kernel {
+    const char *name;
+    int (*supported)(void); // whether the CPU supports the instructions
+    count_fn count[3];
+};
+
+/** Sorted from fastest to slowest */
+static const struct kernel kernels[] = {
+    {"avx512",
+     has_avx512,
+     {count_int32_avx512, count_int16_avx512, count_uint8_avx512}},
+    {"avx2", has_avx2, {count_int32_avx2, count_int16_avx2, count_uint8_avx2}},
+    {"scalar",
+     has_scalar,
+     {count_int32_scalar, count_int16_scalar, count_uint8_scalar}},
+};
+
+// read by every pool thread, set once unless 'kernel_select' is called
+static _Atomic(const struct kernel *) selected = NULL;
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+
+int kernel_select(const char *name) {
+    __builtin_cpu_init();
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (name != NULL && strcmp(name, kernels[i].name) != 0)
+            continue;
+        if (!kernels[i].supported())
+            continue;
+        atomic_store_explicit(&selected, &kernels[i], memory_order_release);
+        return 0;
+    }
+    return -1;
+}
+
+static void select_default(void) {
+    if (atomic_load_explicit(&selected, memory_order_acquire) == NULL)
+        kernel_select(NULL);
+}
+
+/**
+ * @brief The selected kernels, the best supported ones if none was selected.
+ * The first callers may be several threads at once
+ */
+static const struct kernel *current(void) {
+    const struct kernel *k =
+        atomic_load_explicit(&selected, memory_order_acquire);
+    if (k == NULL) {
+        pthread_once(&default_once, select_default);
+        k = atomic_load_explicit(&selected, memory_order_acquire);
+    }
+    return k;
+}
+
+const char *kernel_name(void) {
+    return current()->name;
+}
+
+size_t count_above(int dtype, const void *row, size_t n, long threshold) {
+    const struct kernel *k = current();
+
+    // clamp thresholds outside the range of the type, so it fits in a lane
+    long min, max;
+    switch (dtype) {
+        case DTYPE_INT16:
+            min = INT16_MIN, max = INT16_MAX;
+            break;
+        case DTYPE_UINT8:
+            min = 0, max = UINT8_MAX;
+            break;
+        default:
+            min = INT32_MIN, max = INT32_MAX;
+    }
+    if (threshold >= max)
+        return 0;
+    if (threshold < min)
+        return n;
+    return k->count[dtype](row, n, threshold);
+}
@@ -0,0 +1,40 @@
+/**
+ * Vectorized count-above-threshold kernels for matrix rows.
+ *
+ * There is one implementation per instruction set (AVX-512, AVX2 and plain C)
+ * and per element type. The best one supported by the CPU is picked at run
+ * time, the first time `count_above` is called, once even if threads call it
+ * at the same time.
+ */
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stddef.h>
+
+/**
+ * @brief Selects the kernels to use
+ *
+ * @param name `"avx512"`, `"avx2"` or `"scalar"`. `NULL` selects the best
+ * one supported by the CPU
+ * @retval -1 - Unknown name, or not supported by the CPU
+ * @retval 0 - OK
+ */
+int kernel_select(const char *name);
+
+/**
+ * @brief Name of the selected kernels, e.g. `"avx2"`
+ */
+const char *kernel_name(void);
+
+/**
+ * @brief Counts the elements of a row that are greater than `threshold`
+ *
+ * @param dtype The element type, `enum matrix_dtype`
+ * @param row The row, does not need to be aligned
+ * @param n Number of elements in the row
+ * @param threshold The threshold, may be out of the range of `dtype`
+ * @return The number of elements greater than `threshold`
+ */
+size_t count_above(int dtype, const void *row, size_t n, long threshold);
+
+#endif
@@ -0,0 +1,204 @@
+#include "matrix.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Rounds `x` up to a multiple of `MATRIX_ALIGN` */
+#define ALIGN_UP(x) (((x) + MATRIX_ALIGN - 1) & ~(size_t)(MATRIX_ALIGN - 1))
+
+size_t dtype_size(int dtype) {
+    switch (dtype) {
+        case DTYPE_INT32:
+            return sizeof(int32_t);
+        case DTYPE_INT16:
+            return sizeof(int16_t);
+        case DTYPE_UINT8:
+            return sizeof(uint8_t);
+        default:
+            return 0;
+    }
+}
+
+int dtype_parse(const char *name) {
+    if (strcmp(name, "int32") == 0)
+        return DTYPE_INT32;
+    if (strcmp(name, "int16") == 0)
+        return DTYPE_INT16;
+    if (strcmp(name, "uint8") == 0)
+        return DTYPE_UINT8;
+    return -1;
+}
+
+int dtype_fits(int dtype, long value) {
+    switch (dtype) {
+        case DTYPE_INT32:
+            return value >= INT32_MIN && value <= INT32_MAX;
+        case DTYPE_INT16:
+            return value >= INT16_MIN && value <= INT16_MAX;
+        case DTYPE_UINT8:
+            return value >= 0 && value <= UINT8_MAX;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Records the identity of the file of a matrix, from its `fstat`
+ */
+static void set_identity(struct matrix *m, const struct stat *st) {
+    m->dev = st->st_dev;
+    m->ino = st->st_ino;
+    m->mtime_sec = st->st_mtim.tv_sec;
+    m->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Validates a header against the size of the file it was read from
+ *
+ * @param hdr The header
+ * @param file_size Size of the file, in bytes
+ * @retval 0 - Invalid header
+ * @retval 1 - OK
+ */
+static int header_is_valid(const struct matrix_header *hdr, size_t file_size) {
+    size_t elem = dtype_size(hdr->dtype);
+    if (memcmp(hdr->magic, MATRIX_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != MATRIX_VERSION || elem == 0)
+        return 0;
+    // rows must be aligned and large enough for 'n' elements, checking that
+    // 'n * elem' does not wrap around first
+    if (hdr->n > SIZE_MAX / elem || (hdr->n > 0 && hdr->stride == 0))
+        return 0;
+    if (hdr->offset % MATRIX_ALIGN != 0 || hdr->stride % MATRIX_ALIGN != 0 ||
+        hdr->offset < sizeof(struct matrix_header) ||
+        hdr->stride < hdr->n * elem)
+        return 0;
+    // check for overflow before checking the file holds every row
+    if (hdr->n != 0 && hdr->stride > (SIZE_MAX - hdr->offset) / hdr->n)
+        return 0;
+    return hdr->offset + hdr->n * hdr->stride <= file_size;
+}
+
+int matrix_map(const char *path, struct matrix *m) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(struct matrix_header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps its own reference to the file
+    if (map == MAP_FAILED)
+        return -1;
+
+    const struct matrix_header *hdr = map;
+    if (!header_is_valid(hdr, st.st_size)) {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    m->n = hdr->n;
+    m->stride = hdr->stride;
+    m->dtype = hdr->dtype;
+    m->data = (char *)map + hdr->offset;
+    m->map = map;
+    m->size = st.st_size;
+    set_identity(m, &st);
+    return 0;
+}
+
+/**
+ * @brief Computes the stride of the rows and the size of the file of a
+ * matrix, as `matrix_create` lays it out
+ *
+ * @param n Number of rows and columns
+ * @param elem Size of an element
+ * @param stride Output, bytes between the start of consecutive rows
+ * @param size Output, size of the file
+ * @retval 0 - The size does not fit in an `off_t`
+ * @retval 1 - OK
+ */
+static int layout(size_t n, size_t elem, size_t *stride, size_t *size) {
+    size_t offset = ALIGN_UP(sizeof(struct matrix_header));
+    // the same checks as 'header_is_valid', before multiplying
+    if (n != 0 && n > (SIZE_MAX - MATRIX_ALIGN) / elem)
+        return 0;
+    *stride = ALIGN_UP(n * elem);
+    if (n != 0 && *stride > ((size_t)INT64_MAX - offset) / n)
+        return 0;
+    *size = offset + n * *stride;
+    return 1;
+}
+
+size_t matrix_file_size(size_t n, int dtype) {
+    size_t elem = dtype_size(dtype), stride, size;
+    if (elem == 0 || !layout(n, elem, &stride, &size))
+        return 0;
+    return size;
+}
+
+int matrix_create(const char *path, size_t n, int dtype, struct matrix *m) {
+    size_t elem = dtype_size(dtype);
+    if (elem == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t stride, size;
+    if (!layout(n, elem, &stride, &size)) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    struct matrix_header hdr = {0};
+    memcpy(hdr.magic, MATRIX_MAGIC, sizeof(hdr.magic));
+    hdr.version = MATRIX_VERSION;
+    hdr.dtype = dtype;
+    hdr.n = n;
+    hdr.stride = stride;
+    hdr.offset = ALIGN_UP(sizeof(struct matrix_header));
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        return -1;
+    // the file is sparse until rows are written
+    struct stat st;
+    if (ftruncate(fd, size) == -1 || fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    memcpy(map, &hdr, sizeof(hdr));
+
+    m->n = n;
+    m->stride = hdr.stride;
+    m->dtype = dtype;
+    m->data = (char *)map + hdr.offset;
+    m->map = map;
+    m->size = size;
+    set_identity(m, &st);
+    return 0;
+}
+
+void matrix_unmap(struct matrix *m) {
+    munmap(m->map, m->size);
+    m->map = NULL;
+    m->data = NULL;
+}
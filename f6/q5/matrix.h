@@ -0,0 +1,131 @@
+/**
+ * Binary matrix format used by the q5 tools.
+ *
+ * Layout of a file:
+ * - A `struct matrix_header`, padded to `MATRIX_ALIGN` bytes
+ * - `n` rows in row-major order. Each row takes `stride` bytes, a multiple of
+ *   `MATRIX_ALIGN`, and starts at `offset + i * stride`
+ *
+ * All header fields are stored in host byte order.
+ */
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MATRIX_MAGIC "SOMATRIX"
+#define MATRIX_VERSION 1
+#define MATRIX_ALIGN 64
+
+/** Type of the matrix elements */
+enum matrix_dtype {
+    DTYPE_INT32 = 0,
+    DTYPE_INT16 = 1,
+    DTYPE_UINT8 = 2,
+};
+
+/** On-disk header, at offset 0 of the file */
+struct matrix_header {
+    char magic[8];    // MATRIX_MAGIC, not null terminated
+    uint32_t version; // MATRIX_VERSION
+    uint32_t dtype;   // enum matrix_dtype
+    uint64_t n;       // number of rows and columns
+    uint64_t stride;  // bytes between the start of consecutive rows
+    uint64_t offset;  // offset of the first row, from the start of the file
+};
+
+/** A matrix file mapped in memory */
+struct matrix {
+    size_t n;      // number of rows and columns
+    size_t stride; // bytes between the start of consecutive rows
+    int dtype;     // enum matrix_dtype
+    char *data;    // address of the first row
+    void *map;     // address of the whole mapping, i.e., of the header
+    size_t size;   // size of the mapping
+    // identity of the file when it was mapped, to tell if it changed since
+    uint64_t dev, ino;
+    int64_t mtime_sec, mtime_nsec;
+};
+
+/**
+ * @brief Size in bytes of one element of the given type
+ *
+ * @param dtype The element type
+ * @return The size in bytes, or 0 if `dtype` is unknown
+ */
+size_t dtype_size(int dtype);
+
+/**
+ * @brief Parses the name of an element type, e.g. `"int16"`
+ *
+ * @param name The name
+ * @return The `enum matrix_dtype`, or -1 if the name is unknown
+ */
+int dtype_parse(const char *name);
+
+/**
+ * @brief Checks whether a value can be stored in an element of the given type
+ *
+ * @param dtype The element type
+ * @param value The value
+ * @retval 0 - Out of range
+ * @retval 1 - OK
+ */
+int dtype_fits(int dtype, long value);
+
+/**
+ * @brief Size in bytes of a matrix file, as created by `matrix_create`
+ *
+ * @param n Number of rows and columns
+ * @param dtype The element type
+ * @return The size in bytes, or 0 if `dtype` is unknown or the size does not
+ * fit in a file offset
+ */
+size_t matrix_file_size(size_t n, int dtype);
+
+/**
+ * @brief Maps an existing matrix file, read-only and shared, so that forked
+ * processes use the same page cache pages
+ *
+ * @param path The pathname of the matrix file
+ * @param m Output, the mapped matrix
+ * @retval -1 - Error, `errno` is set accordingly. `EINVAL` if the file is not
+ * a valid matrix file
+ * @retval 0 - OK
+ */
+int matrix_map(const char *path, struct matrix *m);
+
+/**
+ * @brief Creates (or truncates) a matrix file of `n`x`n` elements and maps it
+ * for writing. Rows are zero filled
+ *
+ * @param path The pathname of the matrix file
+ * @param n Number of rows and columns
+ * @param dtype The element type
+ * @param m Output, the mapped matrix
+ * @retval -1 - Error, `errno` is set accordingly. `EFBIG` if the file would
+ * be too large for its size to be represented
+ * @retval 0 - OK
+ */
+int matrix_create(const char *path, size_t n, int dtype, struct matrix *m);
+
+/**
+ * @brief Unmaps a matrix mapped with `matrix_map` or `matrix_create`
+ *
+ * @param m The matrix
+ */
+void matrix_unmap(struct matrix *m);
+
+/**
+ * @brief Address of the row `i`
+ *
+ * @param m The matrix
+ * @param i The row index
+ * @return Address of the first element of the row
+ */
+static inline void *matrix_row(const struct matrix *m, size_t i) {
+    return m->data + i * m->stride;
+}
+
+#endif
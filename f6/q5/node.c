@@ -0,0 +1,189 @@
+/**
+ * A node of the multi-node mode of the counter, see `coordinator.c`.
+ *
+ * Listens on a UNIX socket and, for each `struct shard_request`, maps the
+ * matrix file (kept mapped while the requests name the same file), reduces
+ * the requested rows and sends the partial result back.
+ *
+ * To test the coordinator, a node can be made slow (`-d`, a delay before
+ * each response) or unreliable (`-f`, the probability of crashing instead of
+ * responding).
+ */
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "matrix.h"
+#include "node.h"
+#include "reduce.h"
+
+static volatile sig_atomic_t stop = 0;
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+/**
+ * @brief Reads exactly `len` bytes, unless the peer closes the connection
+ *
+ * @return 1 if all bytes were read, 0 on end of stream, -1 on error
+ */
+static int read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t bytes = read(fd, p, len);
+        if (bytes == 0)
+            return 0;
+        if (bytes == -1) {
+            if (errno == EINTR && !stop)
+                continue;
+            return -1;
+        }
+        p += bytes;
+        len -= bytes;
+    }
+    return 1;
+}
+
+/**
+ * @brief Runs a shard request
+ *
+ * @param req The request
+ * @param m The matrix mapped by the previous request, remapped if `req` names
+ * another file
+ * @param path The pathname of `m`, updated along with it
+ * @param resp Output, the response
+ */
+static void run_shard(const struct shard_request *req, struct matrix *m,
+                      char *path, struct response *resp) {
+    memset(resp, 0, sizeof(*resp));
+    if (memchr(req->path, '\0', NODE_PATH_MAX) == NULL) {
+        resp->status = ENAMETOOLONG;
+        return;
+    }
+    if (m->map == NULL || strcmp(path, req->path) != 0) {
+        if (m->map != NULL)
+            matrix_unmap(m);
+        m->map = NULL;
+        if (matrix_map(req->path, m) == -1) {
+            resp->status = errno;
+            m->map = NULL;
+            return;
+        }
+        strcpy(path, req->path);
+    }
+
+    if (req->first > req->last || req->last > m->n || req->q.op < OP_COUNT ||
+        req->q.op > OP_HIST ||
+        (req->q.op == OP_HIST &&
+         (req->q.bins <= 0 || req->q.bins > HIST_MAX_BINS ||
+          req->q.hi < req->q.lo))) {
+        resp->status = EINVAL;
+        return;
+    }
+
+    // only the shard is read, prefetch it and nothing else
+    if (req->last > req->first) {
+        size_t page = sysconf(_SC_PAGESIZE);
+        char *start = (char *)matrix_row(m, req->first);
+        char *end = (char *)matrix_row(m, req->last - 1) + m->stride;
+        char *aligned = (char *)((size_t)start & ~(page - 1));
+        madvise(aligned, end - aligned, MADV_WILLNEED);
+    }
+    reduce_init(&req->q, &resp->r);
+    reduce_rows(m, &req->q, req->first, req->last, &resp->r);
+}
+
+int main(int argc, char *argv[]) {
+    /* validate arguments */
+    long delay_ms = 0;
+    double fail = 0;
+    int opt, bad = 0;
+    while ((opt = getopt(argc, argv, "d:f:")) != -1) {
+        switch (opt) {
+            case 'd':
+                delay_ms = atol(optarg);
+                break;
+            case 'f':
+                fail = atof(optarg);
+                break;
+            default:
+                bad = 1;
+        }
+    }
+    if (bad || argc - optind != 1 || delay_ms < 0 || fail < 0 || fail > 1) {
+        fprintf(stderr,
+                "Usage: %s [-d delay_ms] [-f fail_probability] <socket>\n",
+                argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    char *sock_path = argv[optind];
+
+    /* ------ listen on the socket ------ */
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path '%s' is too long\n", sock_path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, sock_path);
+    unlink(sock_path); // leftover from a previous run
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (lfd == -1 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(lfd, 16) == -1) {
+        fprintf(stderr, "Failed to listen on '%s'. Cause: %s\n", sock_path,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    // no SA_RESTART, so that 'accept' and 'read' return on SIGINT/SIGTERM
+    struct sigaction sa = {.sa_handler = handle_stop};
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    srand(getpid());
+
+    /* ------ serve the coordinator, one connection at a time ------ */
+    struct matrix m = {.map = NULL};
+    char path[NODE_PATH_MAX] = "";
+    while (!stop) {
+        int cfd = accept(lfd, NULL, NULL);
+        if (cfd == -1) {
+            if (errno != EINTR)
+                perror("accept");
+            continue;
+        }
+        struct shard_request req;
+        while (!stop && read_full(cfd, &req, sizeof(req)) == 1) {
+            struct response resp;
+            run_shard(&req, &m, path, &resp);
+            if (delay_ms > 0)
+                nanosleep(&(struct timespec){delay_ms / 1000,
+                                             delay_ms % 1000 * 1000000},
+                          NULL);
+            if (rand() < fail * ((double)RAND_MAX + 1)) {
+                fprintf(stderr, "Node '%s' crashing on rows [%llu, %llu)\n",
+                        sock_path, (unsigned long long)req.first,
+                        (unsigned long long)req.last);
+                unlink(sock_path);
+                _exit(EXIT_FAILURE);
+            }
+            if (write(cfd, &resp, sizeof(resp)) != sizeof(resp))
+                break;
+        }
+        close(cfd);
+    }
+
+    close(lfd);
+    unlink(sock_path);
+    if (m.map != NULL)
+        matrix_unmap(&m);
+    return EXIT_SUCCESS;
+}
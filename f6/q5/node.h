@@ -0,0 +1,28 @@
+/**
+ * Protocol between `coordinator.c` and `node.c`, over a UNIX stream socket.
+ *
+ * Each node stands in for a remote machine: it only knows the pathname of the
+ * binary matrix file, maps it on its own and reads the rows it is asked for.
+ * The coordinator writes a `struct shard_request` and reads back a
+ * `struct response` (see `server.h`), as many times as it wants over the same
+ * connection.
+ */
+#ifndef NODE_H
+#define NODE_H
+
+#include <stdint.h>
+
+#include "reduce.h"
+#include "server.h"
+
+#define NODE_PATH_MAX 256
+
+/** A reduction over the rows `[first, last)` of a matrix file */
+struct shard_request {
+    char path[NODE_PATH_MAX]; // absolute pathname of the binary matrix file
+    struct reduce_query q;
+    uint64_t first;
+    uint64_t last;
+};
+
+#endif
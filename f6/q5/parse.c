@@ -0,0 +1,341 @@
+#include "parse.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/** Range of lines parsed by one worker, in shared memory */
+struct chunk {
+    const char *begin; // first character, at the start of a line
+    const char *end;   // one past the last character
+    size_t first_row;  // index of the row in the first line
+    size_t rows;       // number of lines in the range
+    int nerrors;
+    struct parse_error errors[PARSE_MAX_ERRORS];
+} __attribute__((aligned(64)));
+
+/** Broadcasts a byte to the 8 bytes of a word */
+#define REPEAT8(b) (0x0101010101010101ull * (b))
+
+static const uint64_t powers_of_10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+/**
+ * @brief Parses a run of decimal digits, 8 at a time
+ *
+ * @param pp Address of the pointer to the first digit. Advanced past the
+ * last digit
+ * @param end One past the last readable character
+ * @param value Output, the value of the digits
+ * @return Number of digits parsed, 0 if there is no digit at `*pp`
+ */
+static inline int parse_digits(const char **pp, const char *end,
+                               uint64_t *value) {
+    const char *p = *pp;
+    uint64_t v = 0;
+    int total = 0;
+
+    while (end - p >= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        // the high bit of a byte is set if the byte is not in '0'..'9'
+        uint64_t nondigit =
+            ((w + REPEAT8(0x46)) | (w - REPEAT8(0x30))) & REPEAT8(0x80);
+        int len = nondigit ? __builtin_ctzll(nondigit) / 8 : 8;
+        if (len == 0)
+            break;
+        // drop the bytes after the last digit, the remaining are left padded
+        // with zeros, i.e., the value does not change. Then combine pairs of
+        // digits, pairs of pairs and pairs of those, without branches
+        w = (w - REPEAT8(0x30)) << (8 * (8 - len));
+        w = (w & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+        w = (w & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+        w = (w & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32;
+        v = v * powers_of_10[len] + w;
+        total += len;
+        p += len;
+        if (len < 8 || total > 18)
+            break;
+    }
+    // less than 8 readable bytes left, at the end of the file
+    while (p < end && *p >= '0' && *p <= '9' && total <= 18) {
+        v = v * 10 + (*p++ - '0');
+        total++;
+    }
+
+    *pp = p;
+    *value = v;
+    return total;
+}
+
+/**
+ * @brief Records an error of the chunk, if there is room for it
+ */
+static void add_error(struct chunk *c, size_t row, const char *fmt, long a,
+                      long b) {
+    if (c->nerrors == PARSE_MAX_ERRORS)
+        return;
+    struct parse_error *e = &c->errors[c->nerrors++];
+    e->row = row;
+    snprintf(e->msg, sizeof(e->msg), fmt, a, b);
+}
+
+/**
+ * @brief Parses one line into a row of the matrix
+ *
+ * @param p First character of the line
+ * @param eol End of the line, i.e., the '\n' or the end of the chunk
+ * @param m The matrix
+ * @param i Index of the row
+ * @param c The chunk, where errors are recorded
+ */
+static void parse_line(const char *p, const char *eol, struct matrix *m,
+                       size_t i, struct chunk *c) {
+    void *row = matrix_row(m, i);
+    size_t j = 0;
+    for (;;) {
+        while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+            p++;
+        if (p == eol)
+            break;
+
+        int neg = *p == '-';
+        p += neg;
+        uint64_t digits;
+        int len = parse_digits(&p, eol, &digits);
+        if (len == 0 || (p < eol && *p != ' ' && *p != '\t' && *p != '\r')) {
+            add_error(c, i + 1, "malformed value in column %ld", j + 1, 0);
+            return;
+        }
+        long value = neg ? -(long)digits : (long)digits;
+        if (len > 18 || !dtype_fits(m->dtype, value)) {
+            add_error(c, i + 1, "value out of range in column %ld", j + 1, 0);
+            return;
+        }
+
+        if (j < m->n) {
+            switch (m->dtype) {
+                case DTYPE_INT32:
+                    ((int32_t *)row)[j] = value;
+                    break;
+                case DTYPE_INT16:
+                    ((int16_t *)row)[j] = value;
+                    break;
+                case DTYPE_UINT8:
+                    ((uint8_t *)row)[j] = value;
+                    break;
+            }
+        }
+        j++;
+    }
+    if (j != m->n)
+        add_error(c, i + 1, "expected %ld columns, got %ld", m->n, j);
+}
+
+/**
+ * @brief Phase 1 of a worker, counts the lines of the chunk
+ */
+static void count_lines(struct chunk *c) {
+    size_t rows = 0;
+    const char *p = c->begin;
+    while (p < c->end && (p = memchr(p, '\n', c->end - p)) != NULL) {
+        rows++;
+        p++;
+    }
+    // the last line of the file may not end with '\n'
+    if (c->end > c->begin && c->end[-1] != '\n')
+        rows++;
+    c->rows = rows;
+}
+
+/**
+ * @brief Phase 2 of a worker, parses every line of the chunk
+ */
+static void parse_lines(struct chunk *c, struct matrix *m) {
+    const char *p = c->begin;
+    for (size_t i = c->first_row; p < c->end; i++) {
+        const char *eol = memchr(p, '\n', c->end - p);
+        if (eol == NULL)
+            eol = c->end;
+        // rows past 'n' are reported by the parent
+        if (i < m->n)
+            parse_line(p, eol, m, i, c);
+        p = eol + 1;
+    }
+}
+
+/**
+ * @brief Runs one phase of the parsing with a worker per chunk, and waits for
+ * the workers
+ *
+ * @param chunks The chunks, in shared memory
+ * @param nprocs Number of chunks and of workers
+ * @param m The matrix, `NULL` for phase 1
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+static int run_phase(struct chunk *chunks, int nprocs, struct matrix *m) {
+    int started = 0;
+    for (; started < nprocs; started++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            break;
+        if (pid == 0) {
+            if (m == NULL)
+                count_lines(&chunks[started]);
+            else
+                parse_lines(&chunks[started], m);
+            _exit(EXIT_SUCCESS);
+        }
+    }
+
+    int failed = started < nprocs;
+    int saved_errno = errno;
+    for (int i = 0; i < started; i++) {
+        int status;
+        if (waitpid(-1, &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != EXIT_SUCCESS) {
+            failed = 1;
+            saved_errno = ECHILD;
+        }
+    }
+    if (failed) {
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+
+int text_open(const char *path, struct text *t) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    // the file is read once, from start to end
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    /* first line indicates matrix size (nxn) */
+    const char *p = map, *end = p + st.st_size;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    uint64_t n;
+    if (parse_digits(&p, end, &n) == 0 || n == 0) {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+    const char *body = memchr(p, '\n', end - p);
+    body = body == NULL ? end : body + 1;
+
+    // trailing empty lines are not rows
+    while (end > body && (end[-1] == '\n' || end[-1] == '\r' ||
+                          end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+
+    t->n = n;
+    t->body = body;
+    t->end = end;
+    t->map = map;
+    t->size = st.st_size;
+    return 0;
+}
+
+void text_close(struct text *t) {
+    munmap(t->map, t->size);
+    t->map = NULL;
+}
+
+/**
+ * @brief Orders errors by row number, for `qsort`
+ */
+static int cmp_errors(const void *a, const void *b) {
+    const struct parse_error *x = a, *y = b;
+    return (x->row > y->row) - (x->row < y->row);
+}
+
+int text_parse(const struct text *t, struct matrix *m, int nprocs,
+               struct parse_error *errors) {
+    if (nprocs <= 0 || m->n != t->n) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* ------ setup shared memory ------ */
+    size_t size = nprocs * sizeof(struct chunk);
+    struct chunk *chunks = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (chunks == MAP_FAILED)
+        return -1;
+
+    /* ------ split the text in ranges of whole lines ------ */
+    size_t len = t->end - t->body;
+    const char *begin = t->body;
+    for (int i = 0; i < nprocs; i++) {
+        const char *end = t->body + len * (i + 1) / nprocs;
+        // move the boundary past the end of the line
+        if (end < begin)
+            end = begin;
+        if (i == nprocs - 1 || (end = memchr(end, '\n', t->end - end)) == NULL)
+            end = t->end;
+        else
+            end++;
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+        begin = end;
+    }
+
+    /* ------ phase 1: count lines, to find the first row of each chunk ---- */
+    if (run_phase(chunks, nprocs, NULL) == -1) {
+        munmap(chunks, size);
+        return -1;
+    }
+    size_t rows = 0;
+    for (int i = 0; i < nprocs; i++) {
+        chunks[i].first_row = rows;
+        rows += chunks[i].rows;
+    }
+
+    /* ------ phase 2: parse ------ */
+    if (run_phase(chunks, nprocs, m) == -1) {
+        munmap(chunks, size);
+        return -1;
+    }
+
+    /* ------ gather errors ------ */
+    int nerrors = 0;
+    for (int i = 0; i < nprocs; i++)
+        for (int j = 0; j < chunks[i].nerrors; j++)
+            errors[nerrors++] = chunks[i].errors[j];
+    if (rows != t->n) {
+        struct parse_error *e = &errors[nerrors++];
+        e->row = rows < t->n ? rows + 1 : t->n + 1;
+        snprintf(e->msg, sizeof(e->msg), "expected %zu rows, got %zu", t->n,
+                 rows);
+    }
+    qsort(errors, nerrors, sizeof(errors[0]), cmp_errors);
+
+    munmap(chunks, size);
+    return nerrors;
+}
@@ -0,0 +1,69 @@
+/**
+ * Parallel loader for matrices in the text format used by `original.c`: the
+ * first line is the size `n`, followed by `n` lines with `n` integers each.
+ *
+ * The text file is mapped in memory and split into byte ranges that start and
+ * end at line boundaries. Forked workers first count the lines of each range,
+ * to know the index of its first row, and then parse the ranges in parallel,
+ * writing every row straight into its final position in a shared mapping.
+ */
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stddef.h>
+
+#include "matrix.h"
+
+/** Maximum number of errors reported by each worker */
+#define PARSE_MAX_ERRORS 8
+
+/** A text matrix file mapped in memory */
+struct text {
+    size_t n;         // matrix size, from the first line
+    const char *body; // first character after the first line
+    const char *end;  // one past the last non-whitespace character
+    void *map;        // address of the mapping
+    size_t size;      // size of the mapping
+};
+
+/** A malformed row */
+struct parse_error {
+    size_t row;    // row number, starting at 1 for the line after the size
+    char msg[56];  // description, e.g. "expected 5 columns, got 4"
+};
+
+/**
+ * @brief Maps a text matrix file and parses its first line
+ *
+ * @param path The pathname of the text file
+ * @param t Output, the mapped text
+ * @retval -1 - Error, `errno` is set accordingly. `EINVAL` if the first line
+ * is not a valid size
+ * @retval 0 - OK
+ */
+int text_open(const char *path, struct text *t);
+
+/**
+ * @brief Unmaps a text file mapped by `text_open`
+ *
+ * @param t The mapped text
+ */
+void text_close(struct text *t);
+
+/**
+ * @brief Parses the rows of a text matrix into a matrix, with `nprocs` forked
+ * workers
+ *
+ * @param t The mapped text
+ * @param m The destination, a `t->n`x`t->n` matrix. Must be mapped shared, so
+ * that the rows written by the workers are visible to the caller
+ * @param nprocs The number of worker processes
+ * @param errors Output, array with room for `nprocs * PARSE_MAX_ERRORS + 1`
+ * errors, sorted by row number
+ * @return The number of errors written to `errors`, 0 if the matrix is valid,
+ * or -1 if the workers could not be run (`errno` is set accordingly)
+ */
+int text_parse(const struct text *t, struct matrix *m, int nprocs,
+               struct parse_error *errors);
+
+#endif
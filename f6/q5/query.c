@@ -0,0 +1,170 @@
+/**
+ * Answers "how many values are above T" for several thresholds against the
+ * same binary matrix (see `matrix.h`), using the index from `index.h`.
+ *
+ * The index is built the first time, and rebuilt whenever the matrix file
+ * changes. Afterwards, each query is a binary search in the index and the
+ * matrix is not read at all. A matrix with too many distinct values to be
+ * indexed (`INDEX_MAX_DISTINCT`) is scanned instead, once for all the
+ * thresholds; the index file remembers it, so it is not counted again.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "index.h"
+#include "matrix.h"
+
+/** A threshold and its position in the arguments */
+struct threshold {
+    long value;
+    int arg;
+};
+
+static int cmp_thresholds(const void *a, const void *b) {
+    const struct threshold *x = a, *y = b;
+    return (x->value > y->value) - (x->value < y->value);
+}
+
+/**
+ * @brief Number of thresholds below `x`, in ascending order
+ */
+static inline size_t below(const struct threshold *t, size_t n, long x) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (t[mid].value < x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Defines `scan_row_<T>`, which counts each element of a row of type `T` in
+ * `hits[k]`, `k` being the number of thresholds below it
+ */
+#define DEFINE_SCAN_ROW(T)                                                     \
+    static void scan_row_##T(const T *row, size_t len,                         \
+                             const struct threshold *t, size_t n,              \
+                             uint64_t *hits) {                                 \
+        for (size_t j = 0; j < len; j++)                                       \
+            hits[below(t, n, row[j])]++;                                       \
+    }
+
+DEFINE_SCAN_ROW(int32_t)
+DEFINE_SCAN_ROW(int16_t)
+DEFINE_SCAN_ROW(uint8_t)
+
+/**
+ * @brief Answers the queries with a single pass over the matrix, for a matrix
+ * that cannot be indexed. Exits on failure
+ *
+ * @param m The matrix
+ * @param args The thresholds
+ * @param n The number of thresholds
+ */
+void scan(const struct matrix *m, char **args, int n) {
+    struct threshold *t = malloc(n * sizeof(*t));
+    uint64_t *hits = calloc(n + 1, sizeof(*hits));
+    if (t == NULL || hits == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < n; i++)
+        t[i] = (struct threshold){atol(args[i]), i};
+    qsort(t, n, sizeof(*t), cmp_thresholds);
+
+    for (size_t i = 0; i < m->n; i++) {
+        const void *row = matrix_row(m, i);
+        if (m->dtype == DTYPE_INT32)
+            scan_row_int32_t(row, m->n, t, n, hits);
+        else if (m->dtype == DTYPE_INT16)
+            scan_row_int16_t(row, m->n, t, n, hits);
+        else
+            scan_row_uint8_t(row, m->n, t, n, hits);
+    }
+
+    // an element with k thresholds below it is above the k smallest ones
+    uint64_t *above = malloc(n * sizeof(*above));
+    if (above == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t acc = 0;
+    for (int k = n; k > 0; k--) {
+        acc += hits[k];
+        above[t[k - 1].arg] = acc;
+    }
+    for (int i = 0; i < n; i++)
+        printf("%ld %" PRIu64 "\n", atol(args[i]), above[i]);
+    free(t);
+    free(hits);
+    free(above);
+}
+
+int main(int argc, char *argv[]) {
+    /* validate arguments */
+    int rebuild = 0;
+    int opt; // '+' stops at the first non-option, thresholds can be negative
+    while ((opt = getopt(argc, argv, "+r")) != -1) {
+        if (opt != 'r')
+            break;
+        rebuild = 1;
+    }
+    if (argc - optind < 2) {
+        fprintf(stderr, "Usage: %s [-r] <matrix.bin> <threshold> [...]\n",
+                argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    char *path = argv[optind];
+
+    // the index is checked against the mapped file, not whatever the path
+    // names by then
+    struct matrix m;
+    if (matrix_map(path, &m) == -1) {
+        fprintf(stderr, "Failed to map '%s'. Cause: %s\n", path,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* map the index, (re)building it when missing or stale */
+    struct index idx;
+    int r = rebuild ? index_build(path, &m) : 0;
+    if (r == 0 && (r = index_map(path, &m, &idx)) == -1 &&
+        (errno == ENOENT || errno == ESTALE || errno == EINVAL)) {
+        r = index_build(path, &m);
+        if (r == 0)
+            r = index_map(path, &m, &idx);
+    }
+    if (r == -1 && errno != E2BIG) {
+        fprintf(stderr, "Failed to index '%s'. Cause: %s\n", path,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (r == -1) {
+        fprintf(stderr,
+                "'%s' has more than %" PRIu64
+                " distinct values, scanning it instead\n",
+                path, INDEX_MAX_DISTINCT);
+        scan(&m, &argv[optind + 1], argc - optind - 1);
+        matrix_unmap(&m);
+        return EXIT_SUCCESS;
+    }
+
+    /* answer the queries, one line each */
+    for (int i = optind + 1; i < argc; i++) {
+        long threshold = atol(argv[i]);
+        printf("%ld %" PRIu64 "\n", threshold,
+               index_count_above(&idx, threshold));
+    }
+
+    index_unmap(&idx);
+    matrix_unmap(&m);
+    return EXIT_SUCCESS;
+}
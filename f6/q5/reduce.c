@@ -0,0 +1,302 @@
+#include "reduce.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kernel.h"
+
+/** Chunks per worker in PART_DYNAMIC, more chunks balance better */
+#define CHUNKS_PER_WORKER 16
+/** The costly rows of 'reduce_set_skew' are the first 1/SKEW_FRACTION */
+#define SKEW_FRACTION 8
+
+static int skew = 1;
+static int (*place)(int id); // of 'reduce_set_placement'
+
+/** Shared state of a run, the first field gets a cache line of its own */
+struct shared {
+    _Alignas(CACHE_LINE) atomic_size_t next_row; // PART_DYNAMIC only
+    struct reduce_result slots[];                // one per worker
+};
+
+static const char *op_names[] = {"count", "sum", "min", "max", "range", "hist"};
+static const char *partition_names[] = {"block", "cyclic", "dynamic"};
+
+int reduce_op_parse(const char *name) {
+    for (size_t i = 0; i < sizeof(op_names) / sizeof(op_names[0]); i++)
+        if (strcmp(name, op_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+int partition_parse(const char *name) {
+    for (size_t i = 0; i < sizeof(partition_names) / sizeof(partition_names[0]);
+         i++)
+        if (strcmp(name, partition_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+void reduce_set_skew(int factor) {
+    skew = factor > 1 ? factor : 1;
+}
+
+void reduce_set_placement(int (*apply)(int id)) {
+    place = apply;
+}
+
+void reduce_init(const struct reduce_query *q, struct reduce_result *r) {
+    memset(r, 0, sizeof(*r));
+    if (q->op == OP_MIN)
+        r->value = INT64_MAX;
+    else if (q->op == OP_MAX)
+        r->value = INT64_MIN;
+}
+
+void reduce_merge(const struct reduce_query *q, struct reduce_result *dst,
+                  const struct reduce_result *src) {
+    switch (q->op) {
+        case OP_MIN:
+            if (src->value < dst->value)
+                dst->value = src->value;
+            break;
+        case OP_MAX:
+            if (src->value > dst->value)
+                dst->value = src->value;
+            break;
+        case OP_HIST:
+            for (int i = 0; i < q->bins; i++)
+                dst->hist[i] += src->hist[i];
+            break;
+        default: // counts and sums
+            dst->value += src->value;
+    }
+}
+
+void reduce_print(const struct reduce_query *q, const struct reduce_result *r) {
+    if (q->op != OP_HIST) {
+        printf("%lld\n", r->value);
+        return;
+    }
+    // one line per bin, with the bounds of the bin and the count
+    long long width = q->hi - q->lo + 1;
+    for (int i = 0; i < q->bins; i++) {
+        long long first = q->lo + (width * i + q->bins - 1) / q->bins;
+        long long last = q->lo + (width * (i + 1) + q->bins - 1) / q->bins - 1;
+        printf("[%lld, %lld] %ld\n", first, last, r->hist[i]);
+    }
+}
+
+double reduce_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Defines `reduce_row_<T>`, which accumulates a row of elements of type `T`
+ * into a result, for every operation but OP_COUNT (see `kernel.h`)
+ */
+#define DEFINE_REDUCE_ROW(T)                                                   \
+    static void reduce_row_##T(const struct reduce_query *q, const T *row,    \
+                               size_t n, struct reduce_result *r) {           \
+        /* keep the accumulator in a local, so the compiler can vectorize */  \
+        long long acc = r->value;                                             \
+        switch (q->op) {                                                      \
+            case OP_SUM:                                                      \
+                for (size_t k = 0; k < n; k++)                                \
+                    acc += row[k];                                            \
+                break;                                                        \
+            case OP_MIN:                                                      \
+                for (size_t k = 0; k < n; k++)                                \
+                    acc = row[k] < acc ? row[k] : acc;                        \
+                break;                                                        \
+            case OP_MAX:                                                      \
+                for (size_t k = 0; k < n; k++)                                \
+                    acc = row[k] > acc ? row[k] : acc;                        \
+                break;                                                        \
+            case OP_RANGE:                                                    \
+                for (size_t k = 0; k < n; k++)                                \
+                    acc += row[k] >= q->lo && row[k] <= q->hi;                \
+                break;                                                        \
+            case OP_HIST: {                                                   \
+                long long width = q->hi - q->lo + 1;                          \
+                for (size_t k = 0; k < n; k++) {                              \
+                    if (row[k] < q->lo || row[k] > q->hi)                     \
+                        continue;                                             \
+                    r->hist[(row[k] - q->lo) * q->bins / width]++;            \
+                }                                                             \
+                break;                                                        \
+            }                                                                 \
+        }                                                                     \
+        r->value = acc;                                                       \
+    }
+
+DEFINE_REDUCE_ROW(int32_t)
+DEFINE_REDUCE_ROW(int16_t)
+DEFINE_REDUCE_ROW(uint8_t)
+
+/**
+ * @brief Accumulates a single row into `r`
+ *
+ * @param m The matrix
+ * @param q The query
+ * @param i The row index
+ * @param r The accumulated result
+ */
+static void reduce_row_once(const struct matrix *m,
+                            const struct reduce_query *q, size_t i,
+                            struct reduce_result *r) {
+    const void *row = matrix_row(m, i);
+    if (q->op == OP_COUNT) {
+        r->value += count_above(m->dtype, row, m->n, q->lo);
+        return;
+    }
+    switch (m->dtype) {
+        case DTYPE_INT32:
+            reduce_row_int32_t(q, row, m->n, r);
+            break;
+        case DTYPE_INT16:
+            reduce_row_int16_t(q, row, m->n, r);
+            break;
+        case DTYPE_UINT8:
+            reduce_row_uint8_t(q, row, m->n, r);
+            break;
+    }
+}
+
+/**
+ * @brief Accumulates a single row into `r`, after reducing it `skew - 1`
+ * more times into a discarded result if it is one of the costly rows
+ */
+static void reduce_row(const struct matrix *m, const struct reduce_query *q,
+                       size_t i, struct reduce_result *r) {
+    if (skew > 1 && i < m->n / SKEW_FRACTION) {
+        struct reduce_result scratch;
+        reduce_init(q, &scratch);
+        for (int k = 1; k < skew; k++)
+            reduce_row_once(m, q, i, &scratch);
+        // the result escapes as far as the compiler knows, so the extra work
+        // is kept, without threads and workers sharing a variable
+        __asm__ volatile("" : : "r"(&scratch) : "memory");
+    }
+    reduce_row_once(m, q, i, r);
+}
+
+void reduce_rows(const struct matrix *m, const struct reduce_query *q,
+                 size_t first, size_t last, struct reduce_result *r) {
+    for (size_t i = first; i < last; i++)
+        reduce_row(m, q, i, r);
+}
+
+/**
+ * @brief Body of the worker `id`, accumulates its share of the rows
+ *
+ * @param m The matrix
+ * @param q The query
+ * @param id The worker index, in `[0, nprocs)`
+ * @param nprocs The number of workers
+ * @param partition The partitioning scheme
+ * @param sh The shared state
+ */
+static void worker(const struct matrix *m, const struct reduce_query *q,
+                   int id, int nprocs, int partition, struct shared *sh) {
+    struct reduce_result local;
+    reduce_init(q, &local);
+
+    switch (partition) {
+        case PART_BLOCK: {
+            // the first 'n % nprocs' workers take one extra row
+            size_t base = m->n / nprocs, extra = m->n % nprocs;
+            size_t first = id * base + ((size_t)id < extra ? (size_t)id : extra);
+            size_t last = first + base + ((size_t)id < extra);
+            reduce_rows(m, q, first, last, &local);
+            break;
+        }
+        case PART_CYCLIC:
+            for (size_t i = id; i < m->n; i += nprocs)
+                reduce_row(m, q, i, &local);
+            break;
+        case PART_DYNAMIC: {
+            size_t chunk = m->n / ((size_t)nprocs * CHUNKS_PER_WORKER);
+            if (chunk == 0)
+                chunk = 1;
+            size_t first;
+            while ((first = atomic_fetch_add_explicit(
+                        &sh->next_row, chunk, memory_order_relaxed)) < m->n) {
+                size_t last = first + chunk < m->n ? first + chunk : m->n;
+                reduce_rows(m, q, first, last, &local);
+            }
+            break;
+        }
+    }
+
+    // single write to the shared slot
+    sh->slots[id] = local;
+}
+
+int reduce_run(const struct matrix *m, const struct reduce_query *q,
+               int nprocs, int partition, struct reduce_result *r) {
+    if (dtype_size(m->dtype) == 0 || nprocs <= 0 ||
+        (q->op == OP_HIST &&
+         (q->bins <= 0 || q->bins > HIST_MAX_BINS || q->hi < q->lo))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* ------ setup shared memory ------ */
+    size_t size = sizeof(struct shared) + nprocs * sizeof(struct reduce_result);
+    struct shared *sh = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh == MAP_FAILED)
+        return -1;
+    atomic_init(&sh->next_row, 0);
+
+    /* ------ start nprocs and do work ------ */
+    int started = 0;
+    for (; started < nprocs; started++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            break;
+        if (pid == 0) {
+            // before any row is read, so that pages faulted in are local
+            if (place != NULL)
+                place(started);
+            worker(m, q, started, nprocs, partition, sh);
+            // skip atexit handlers and stdio buffers inherited from the parent
+            _exit(EXIT_SUCCESS);
+        }
+    }
+
+    /* ------ wait for the workers to finish ------- */
+    int failed = started < nprocs;
+    int saved_errno = errno;
+    for (int i = 0; i < started; i++) {
+        int status;
+        if (waitpid(-1, &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != EXIT_SUCCESS) {
+            failed = 1;
+            saved_errno = ECHILD;
+        }
+    }
+
+    if (!failed) {
+        reduce_init(q, r);
+        for (int i = 0; i < nprocs; i++)
+            reduce_merge(q, r, &sh->slots[i]);
+    }
+    munmap(sh, size);
+    if (failed) {
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+/**
+ * Parallel reduction engine over the rows of a matrix (see `matrix.h`).
+ *
+ * Work is split between forked worker processes with one of the partitioning
+ * schemes in `enum partition`. Each worker accumulates into a local
+ * `struct reduce_result` and writes it once, at the end, to its own slot in a
+ * shared mapping. Slots are cache line aligned, so workers never write to the
+ * same cache line.
+ */
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <stddef.h>
+
+#include "matrix.h"
+
+#define CACHE_LINE 64
+#define HIST_MAX_BINS 64
+
+/** Reduction to compute over every element `x` of the matrix */
+enum reduce_op {
+    OP_COUNT, // number of elements with x > lo
+    OP_SUM,   // sum of the elements
+    OP_MIN,   // smallest element
+    OP_MAX,   // largest element
+    OP_RANGE, // number of elements with lo <= x <= hi
+    OP_HIST,  // histogram of [lo, hi] in `bins` equal-width bins
+};
+
+/** How the rows are split between the workers */
+enum partition {
+    PART_BLOCK,   // worker i takes a contiguous block of about n/nprocs rows
+    PART_CYCLIC,  // worker i takes rows i, i + nprocs, i + 2 * nprocs, ...
+    PART_DYNAMIC, // workers grab chunks of rows from a shared counter
+};
+
+/** Parameters of a reduction */
+struct reduce_query {
+    int op;    // enum reduce_op
+    long lo;   // threshold for OP_COUNT, lower bound for OP_RANGE and OP_HIST
+    long hi;   // upper bound for OP_RANGE and OP_HIST
+    int bins;  // number of bins for OP_HIST, at most HIST_MAX_BINS
+};
+
+/** Result of a reduction. For OP_HIST, values out of [lo, hi] are ignored */
+struct reduce_result {
+    long long value;           // count, sum, min or max, depending on the op
+    long hist[HIST_MAX_BINS];  // OP_HIST only
+} __attribute__((aligned(CACHE_LINE)));
+
+/**
+ * @brief Parses the name of an operation, e.g. `"count"`
+ *
+ * @param name The name
+ * @return The `enum reduce_op`, or -1 if the name is unknown
+ */
+int reduce_op_parse(const char *name);
+
+/**
+ * @brief Parses the name of a partitioning scheme, e.g. `"block"`
+ *
+ * @param name The name
+ * @return The `enum partition`, or -1 if the name is unknown
+ */
+int partition_parse(const char *name);
+
+/**
+ * @brief Sets `r` to the identity of the reduction, i.e., the result of
+ * reducing zero elements
+ *
+ * @param q The query
+ * @param r The result to initialize
+ */
+void reduce_init(const struct reduce_query *q, struct reduce_result *r);
+
+/**
+ * @brief Accumulates the result `src` into `dst`
+ *
+ * @param q The query
+ * @param dst The accumulated result
+ * @param src The result to be added
+ */
+void reduce_merge(const struct reduce_query *q, struct reduce_result *dst,
+                  const struct reduce_result *src);
+
+/**
+ * @brief Prints a result in stdout: the value, or one line per bin of a
+ * histogram with its bounds and count
+ *
+ * @param q The query
+ * @param r The result
+ */
+void reduce_print(const struct reduce_query *q, const struct reduce_result *r);
+
+/**
+ * @brief Current time of the monotonic clock, in seconds, for timing
+ * reductions
+ */
+double reduce_now(void);
+
+/**
+ * @brief Accumulates the rows `[first, last)` of the matrix into `r`,
+ * sequentially
+ *
+ * @param m The matrix
+ * @param q The query
+ * @param first The first row
+ * @param last One past the last row
+ * @param r The accumulated result
+ */
+void reduce_rows(const struct matrix *m, const struct reduce_query *q,
+                 size_t first, size_t last, struct reduce_result *r);
+
+/**
+ * @brief Runs the reduction with `nprocs` forked workers and waits for them
+ *
+ * @param m The matrix, mapped shared so that the workers can read it
+ * @param q The query
+ * @param nprocs The number of worker processes
+ * @param partition The partitioning scheme, `enum partition`
+ * @param r Output, the result of the reduction
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+int reduce_run(const struct matrix *m, const struct reduce_query *q,
+               int nprocs, int partition, struct reduce_result *r);
+
+/**
+ * @brief Same as `reduce_run`, but with the threads of a work-stealing pool
+ * (see `f7/lib/pool.h`) instead of processes, so the rows are balanced
+ * between the workers as they go (defined in `reduce_threads.c`)
+ *
+ * @param m The matrix
+ * @param q The query
+ * @param nthreads The number of workers, including the calling thread
+ * @param r Output, the result of the reduction
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+int reduce_run_threads(const struct matrix *m, const struct reduce_query *q,
+                       int nthreads, struct reduce_result *r);
+
+/**
+ * @brief Makes the rows of the first eighth of the matrix `factor` times as
+ * costly to reduce as the others, for testing the balance of the work. The
+ * extra work does not change the results
+ *
+ * @param factor 1 for uniform rows
+ */
+void reduce_set_skew(int factor);
+
+/**
+ * @brief Sets a function that each worker process of `reduce_run` calls with
+ * its index right after `fork`, to pin itself, e.g. `placement_apply` of
+ * `f7/lib/placement.h`. Failures are ignored: the worker runs unpinned
+ *
+ * @param apply NULL for none (the default)
+ */
+void reduce_set_placement(int (*apply)(int id));
+
+#endif
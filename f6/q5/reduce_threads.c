@@ -0,0 +1,52 @@
+/**
+ * Threaded backend of `reduce.h`, on the work-stealing pool of `f7/lib`. In a
+ * file of its own, so that only the programs using it link the pool.
+ */
+#include <errno.h>
+
+#include "../../f7/lib/pool.h"
+#include "reduce.h"
+
+/** Pieces per worker the rows start split into, at most */
+#define GRAINS_PER_WORKER 64
+
+struct job {
+    const struct matrix *m;
+    const struct reduce_query *q;
+};
+
+static void init(void *arg, void *acc) {
+    struct job *job = arg;
+    reduce_init(job->q, acc);
+}
+
+static void body(void *arg, size_t lo, size_t hi, void *acc) {
+    struct job *job = arg;
+    reduce_rows(job->m, job->q, lo, hi, acc);
+}
+
+static void merge(void *arg, void *dst, const void *src) {
+    struct job *job = arg;
+    reduce_merge(job->q, dst, src);
+}
+
+int reduce_run_threads(const struct matrix *m, const struct reduce_query *q,
+                       int nthreads, struct reduce_result *r) {
+    if (dtype_size(m->dtype) == 0 || nthreads <= 0 ||
+        (q->op == OP_HIST &&
+         (q->bins <= 0 || q->bins > HIST_MAX_BINS || q->hi < q->lo))) {
+        errno = EINVAL;
+        return -1;
+    }
+    struct pool pool;
+    if (pool_create(&pool, nthreads) == -1)
+        return -1;
+    struct job job = {m, q};
+    size_t grain = m->n / ((size_t)nthreads * GRAINS_PER_WORKER);
+    int ret = pool_reduce(&pool, m->n, grain, sizeof(struct reduce_result),
+                          init, body, merge, &job, r);
+    int saved_errno = errno;
+    pool_destroy(&pool);
+    errno = saved_errno;
+    return ret;
+}
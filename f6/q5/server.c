@@ -0,0 +1,409 @@
+/**
+ * Long-lived version of `counter.c`, for many queries against the same matrix.
+ *
+ * The matrix is mapped once and `nworkers` processes are forked once. Between
+ * queries, the workers sleep on a futex. For each query received on the UNIX
+ * socket, the server writes a job descriptor to shared memory and wakes the
+ * workers, which split the rows between them dynamically and write their
+ * results to their own slots. The last worker to finish wakes the server.
+ *
+ * Text matrices are loaded through the cache from `cache.h`.
+ *
+ * So, a query costs two futex wake-ups instead of reparsing the matrix and
+ * forking the workers. Clients are multiplexed with `poll`, so an idle or slow
+ * client does not hold up the others, and their queries run one at a time on
+ * the workers. A worker that dies fails the query it was running, and is
+ * started again for the next ones. One that dies between queries is started
+ * again right away, on SIGCHLD.
+ */
+#define _GNU_SOURCE // accept4, ppoll
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "matrix.h"
+#include "reduce.h"
+#include "server.h"
+
+/** Rows taken at a time by a worker */
+#define CHUNK_ROWS 16
+/** Clients connected at the same time, at most. The others wait in the
+ * backlog of the socket */
+#define MAX_CLIENTS 64
+/** Interval at which the server checks that the workers are alive, while it
+ * waits for a job */
+#define WORKER_CHECK_MS 100
+
+/** Job descriptor, in shared memory */
+struct job {
+    // bumped by the server for each job, workers sleep on it
+    _Alignas(CACHE_LINE) atomic_uint generation;
+    int quit; // workers exit when they see this set
+    struct reduce_query q;
+    size_t first, last;
+    // the next row to be processed, workers take CHUNK_ROWS at a time
+    _Alignas(CACHE_LINE) atomic_size_t next_row;
+    // workers that finished the current job, the server sleeps on it
+    _Alignas(CACHE_LINE) atomic_uint done;
+    struct reduce_result slots[]; // one per worker
+};
+
+static volatile sig_atomic_t stop = 0;
+static volatile sig_atomic_t child_exited = 0;
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static void handle_child(int sig) {
+    (void)sig;
+    child_exited = 1;
+}
+
+/** A connection, and the request being read from it */
+struct client {
+    int fd;
+    size_t got; // bytes of `req` read so far
+    struct request req;
+};
+
+/**
+ * @brief Sleeps while `*addr == val`, at most `timeout_ms` milliseconds (-1
+ * for no limit). The futex is not private, since it is shared between
+ * processes
+ */
+static void futex_wait(atomic_uint *addr, unsigned val, long timeout_ms) {
+    struct timespec ts = {.tv_sec = timeout_ms / 1000,
+                          .tv_nsec = timeout_ms % 1000 * 1000000};
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, timeout_ms < 0 ? NULL : &ts,
+            NULL, 0);
+}
+
+/**
+ * @brief Wakes up to `n` processes sleeping on `addr`
+ */
+static void futex_wake(atomic_uint *addr, int n) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+/**
+ * @brief Body of a worker. Waits for jobs and runs them, until told to quit
+ *
+ * @param m The matrix
+ * @param job The job descriptor
+ * @param id The worker index
+ * @param nworkers The number of workers
+ * @param seen The generation of the last job, not to be run
+ */
+static void worker(const struct matrix *m, struct job *job, int id,
+                   int nworkers, unsigned seen) {
+    for (;;) {
+        unsigned gen;
+        while ((gen = atomic_load(&job->generation)) == seen)
+            futex_wait(&job->generation, seen, -1);
+        seen = gen;
+        if (job->quit)
+            return;
+
+        struct reduce_result local;
+        reduce_init(&job->q, &local);
+        size_t first;
+        while ((first = atomic_fetch_add(&job->next_row, CHUNK_ROWS)) <
+               job->last) {
+            size_t last =
+                first + CHUNK_ROWS < job->last ? first + CHUNK_ROWS : job->last;
+            reduce_rows(m, &job->q, first, last, &local);
+        }
+        job->slots[id] = local;
+
+        // the last one to finish wakes the server
+        if (atomic_fetch_add(&job->done, 1) + 1 == (unsigned)nworkers)
+            futex_wake(&job->done, 1);
+    }
+}
+
+/**
+ * @brief Forks worker `id`, which waits for the jobs after the current one.
+ * Exits on failure
+ *
+ * @return The pid of the worker
+ */
+static pid_t start_worker(const struct matrix *m, struct job *job, int id,
+                          int nworkers) {
+    unsigned seen = atomic_load(&job->generation);
+    pid_t pid;
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        // do not outlive the server, even if it is killed
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        worker(m, job, id, nworkers, seen);
+        _exit(EXIT_SUCCESS);
+    }
+    return pid;
+}
+
+/**
+ * @brief Reaps the workers that died, without waiting
+ *
+ * @param pids The pids of the workers, set to 0 for those reaped
+ * @param nworkers The number of workers
+ * @return The number of workers reaped
+ */
+static int reap_workers(pid_t *pids, int nworkers) {
+    int dead = 0, status;
+    for (int i = 0; i < nworkers; i++) {
+        if (pids[i] == 0 || waitpid(pids[i], &status, WNOHANG) != pids[i])
+            continue;
+        if (WIFSIGNALED(status))
+            fprintf(stderr, "Worker %d killed by signal %d\n", i,
+                    WTERMSIG(status));
+        else
+            fprintf(stderr, "Worker %d exited with %d\n", i,
+                    WEXITSTATUS(status));
+        pids[i] = 0;
+        dead++;
+    }
+    return dead;
+}
+
+/**
+ * @brief Starts again the workers reaped by `reap_workers`. Exits on failure
+ */
+static void restart_workers(const struct matrix *m, struct job *job,
+                            pid_t *pids, int nworkers) {
+    for (int i = 0; i < nworkers; i++)
+        if (pids[i] == 0)
+            pids[i] = start_worker(m, job, i, nworkers);
+}
+
+/**
+ * @brief Runs a request on the workers and waits for the result. If a worker
+ * dies, the request fails with `EIO` once the others are done, and the worker
+ * is started again
+ *
+ * @param m The matrix
+ * @param job The job descriptor
+ * @param pids The pids of the workers
+ * @param nworkers The number of workers
+ * @param req The request
+ * @param resp Output, the response
+ */
+static void run_job(const struct matrix *m, struct job *job, pid_t *pids,
+                    int nworkers, const struct request *req,
+                    struct response *resp) {
+    memset(resp, 0, sizeof(*resp));
+    size_t last = req->last == 0 ? m->n : req->last;
+    if (req->first > last || last > m->n || req->q.op < OP_COUNT ||
+        req->q.op > OP_HIST ||
+        (req->q.op == OP_HIST &&
+         (req->q.bins <= 0 || req->q.bins > HIST_MAX_BINS ||
+          req->q.hi < req->q.lo))) {
+        resp->status = EINVAL;
+        return;
+    }
+
+    job->q = req->q;
+    job->first = req->first;
+    job->last = last;
+    atomic_store(&job->next_row, req->first);
+    atomic_store(&job->done, 0);
+    // publish the job, the atomic increment orders the writes above
+    atomic_fetch_add(&job->generation, 1);
+    futex_wake(&job->generation, nworkers);
+
+    // a dead worker never counts itself, nor the rows it took: wait for the
+    // others only, checking on the workers whenever the wait times out
+    unsigned done;
+    int dead = 0;
+    while ((done = atomic_load(&job->done)) < (unsigned)(nworkers - dead)) {
+        futex_wait(&job->done, done, WORKER_CHECK_MS);
+        if (atomic_load(&job->done) == done)
+            dead += reap_workers(pids, nworkers);
+    }
+
+    if (dead > 0) {
+        restart_workers(m, job, pids, nworkers);
+        resp->status = EIO;
+        return;
+    }
+    reduce_init(&req->q, &resp->r);
+    for (int i = 0; i < nworkers; i++)
+        reduce_merge(&req->q, &resp->r, &job->slots[i]);
+}
+
+/**
+ * @brief Reads the next part of the request of a client, and answers it once
+ * complete
+ *
+ * @return 0 if the connection stays open, -1 if it must be closed
+ */
+static int serve_client(const struct matrix *m, struct job *job, pid_t *pids,
+                        int nworkers, struct client *c) {
+    ssize_t bytes =
+        read(c->fd, (char *)&c->req + c->got, sizeof(c->req) - c->got);
+    if (bytes == -1)
+        return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    if (bytes == 0)
+        return -1;
+    c->got += bytes;
+    if (c->got < sizeof(c->req))
+        return 0;
+    c->got = 0;
+    struct response resp;
+    run_job(m, job, pids, nworkers, &c->req, &resp);
+    // the socket is non-blocking: a client that does not read its responses
+    // is dropped, rather than blocking the others
+    return write(c->fd, &resp, sizeof(resp)) == sizeof(resp) ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    /* validate arguments */
+    int nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while ((opt = getopt(argc, argv, "j:")) != -1) {
+        if (opt != 'j' || (nworkers = atoi(optarg)) <= 0) {
+            nworkers = -1;
+            break;
+        }
+    }
+    if (nworkers == -1 || argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-j nworkers] <matrix.bin|matrix.txt> <socket>\n",
+                argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    char *infile = argv[optind], *sock_path = argv[optind + 1];
+
+    /* ------ map matrix ------ */
+    struct matrix m;
+    if (matrix_open(infile, nworkers, &m) == -1) {
+        fprintf(stderr, "Failed to map '%s'. Cause: %s\n", infile,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* ------ setup shared memory and start the workers ------ */
+    size_t size = sizeof(struct job) + nworkers * sizeof(struct reduce_result);
+    struct job *job = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (job == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    pid_t *pids = malloc(nworkers * sizeof(*pids));
+    if (pids == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    // SIGCHLD is blocked but while in 'ppoll', so that a worker dying between
+    // queries interrupts it and is noticed at once
+    sigset_t chld, unblocked;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &unblocked);
+    sigaction(SIGCHLD, &(struct sigaction){.sa_handler = handle_child}, NULL);
+    for (int i = 0; i < nworkers; i++)
+        pids[i] = start_worker(&m, job, i, nworkers);
+
+    /* ------ listen on the socket ------ */
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path '%s' is too long\n", sock_path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, sock_path);
+    unlink(sock_path); // leftover from a previous run
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (lfd == -1 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(lfd, 16) == -1) {
+        fprintf(stderr, "Failed to listen on '%s'. Cause: %s\n", sock_path,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    // no SA_RESTART, so that 'ppoll' returns on SIGINT/SIGTERM
+    struct sigaction sa = {.sa_handler = handle_stop};
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    printf("Serving '%s' (%zux%zu) on '%s' with %d workers\n", infile, m.n,
+           m.n, sock_path, nworkers);
+    fflush(stdout);
+
+    /* ------ serve clients, a request at a time from each ready one ------ */
+    // fds[0] is the listening socket, fds[i + 1] is clients[i]
+    struct client clients[MAX_CLIENTS];
+    struct pollfd fds[MAX_CLIENTS + 1];
+    int nclients = 0;
+    while (!stop) {
+        if (child_exited) {
+            child_exited = 0;
+            if (reap_workers(pids, nworkers) > 0)
+                restart_workers(&m, job, pids, nworkers);
+        }
+        fds[0] = (struct pollfd){.fd = lfd, .events = POLLIN};
+        for (int i = 0; i < nclients; i++)
+            fds[i + 1] = (struct pollfd){.fd = clients[i].fd, .events = POLLIN};
+        // when full, new clients wait in the backlog
+        struct pollfd *first = nclients < MAX_CLIENTS ? fds : fds + 1;
+        if (ppoll(first, nclients + 1 - (first - fds), NULL, &unblocked) ==
+            -1) {
+            if (errno != EINTR)
+                perror("ppoll");
+            continue;
+        }
+
+        // from the last, so that removing a client keeps the others in place
+        for (int i = nclients - 1; i >= 0; i--) {
+            if (fds[i + 1].revents == 0 ||
+                serve_client(&m, job, pids, nworkers, &clients[i]) == 0)
+                continue;
+            close(clients[i].fd);
+            clients[i] = clients[--nclients];
+        }
+
+        if (first == fds && (fds[0].revents & POLLIN)) {
+            int cfd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (cfd == -1) {
+                if (errno != EINTR && errno != EAGAIN)
+                    perror("accept");
+                continue;
+            }
+            clients[nclients++] = (struct client){.fd = cfd};
+        }
+    }
+    for (int i = 0; i < nclients; i++)
+        close(clients[i].fd);
+
+    /* ------ stop the workers and clean up ------ */
+    job->quit = 1;
+    atomic_fetch_add(&job->generation, 1);
+    futex_wake(&job->generation, nworkers);
+    for (int i = 0; i < nworkers; i++)
+        if (pids[i] != 0)
+            waitpid(pids[i], NULL, 0);
+    free(pids);
+    close(lfd);
+    unlink(sock_path);
+    munmap(job, size);
+    matrix_unmap(&m);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,26 @@
+/**
+ * Protocol between `server.c` and `client.c`, over a UNIX stream socket.
+ *
+ * The client writes a `struct request` and reads back a `struct response`,
+ * as many times as it wants over the same connection.
+ */
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+#include "reduce.h"
+
+/** A reduction over the rows `[first, last)` of the matrix */
+struct request {
+    struct reduce_query q;
+    uint64_t first;
+    uint64_t last; // 0 means up to the last row
+};
+
+struct response {
+    int32_t status; // 0 if OK, otherwise an errno value
+    struct reduce_result r;
+};
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * Companion of `signalfd.c`. Sends `count` signals to a process at a given
+ * rate with `sigqueue`, with the send time (`CLOCK_MONOTONIC`, nanoseconds)
+ * as payload.
+ *
+ * Then asks the receiver for its statistics by sending SIGRTMAX, and reports
+ * how many signals were sent, delivered and lost, and the average latency.
+ * With a standard signal (e.g. `-s USR1`) pending signals coalesce and most
+ * of a burst is lost. With a real-time signal (the default, `RTMIN`) every
+ * signal is queued, unless the queue limit (`RLIMIT_SIGPENDING`) is reached,
+ * in which case `sigqueue` fails with `EAGAIN` and the signal is rejected.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** How long to wait for the reply of the receiver, in seconds */
+#define REPLY_TIMEOUT 5
+
+/**
+ * @brief Current time of the monotonic clock, in nanoseconds
+ */
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Parses a signal name, e.g. `USR1`, `SIGHUP`, `RTMIN` or `RTMIN+2`
+ *
+ * @param name The name
+ * @return The signal number, or -1 if the name is unknown
+ */
+int parse_signal(const char *name) {
+    if (strncmp(name, "SIG", 3) == 0)
+        name += 3;
+    if (strncmp(name, "RTMIN", 5) == 0) {
+        int offset = name[5] == '+' ? atoi(name + 6) : 0;
+        // SIGRTMAX is reserved for the report request
+        return SIGRTMIN + offset < SIGRTMAX ? SIGRTMIN + offset : -1;
+    }
+    for (int sig = 1; sig < SIGRTMIN; sig++) {
+        const char *abbrev = sigabbrev_np(sig);
+        if (abbrev != NULL && strcmp(name, abbrev) == 0)
+            return sig;
+    }
+    return -1;
+}
+
+void usage(char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-s signal] [-n count] [-r rate] <pid>\n"
+            "  -s  signal to send, e.g. USR1 or RTMIN+1 (default RTMIN)\n"
+            "  -n  number of signals (default 100000)\n"
+            "  -r  signals per second, 0 is as fast as possible (default 0)\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    /* parse arguments */
+    int sig = SIGRTMIN;
+    long count = 100000;
+    double rate = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:r:")) != -1) {
+        switch (opt) {
+            case 's':
+                if ((sig = parse_signal(optarg)) == -1)
+                    usage(argv[0]);
+                break;
+            case 'n':
+                count = atol(optarg);
+                break;
+            case 'r':
+                rate = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1 || count <= 0 || rate < 0)
+        usage(argv[0]);
+    pid_t pid = atoi(argv[optind]);
+
+    /* block the reply signal before anything is sent, so it is not missed */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGRTMAX);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    /* send signals, pacing them with absolute deadlines */
+    long sent = 0, rejected = 0;
+    uint64_t interval = rate > 0 ? 1e9 / rate : 0;
+    uint64_t start = now_ns();
+    for (long i = 0; i < count; i++) {
+        if (interval > 0) {
+            uint64_t deadline = start + i * interval;
+            struct timespec ts = {.tv_sec = deadline / 1000000000ull,
+                                  .tv_nsec = deadline % 1000000000ull};
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+                                   NULL) == EINTR)
+                ;
+        }
+        union sigval value = {.sival_ptr = (void *)(uintptr_t)now_ns()};
+        if (sigqueue(pid, sig, value) == 0) {
+            sent++;
+        } else if (errno == EAGAIN) { // the queue of the receiver is full
+            rejected++;
+        } else {
+            fprintf(stderr, "Failed to send signal to %d. Cause: %s\n", pid,
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    /*
+     * request the statistics. Pending signals are delivered lowest number
+     * first, so SIGRTMAX is read after every signal sent before it
+     */
+    union sigval request = {.sival_int = 0};
+    if (sigqueue(pid, SIGRTMAX, request) == -1) {
+        fprintf(stderr, "Failed to request statistics. Cause: %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    siginfo_t info;
+    struct timespec timeout = {.tv_sec = REPLY_TIMEOUT};
+    do {
+        if (sigtimedwait(&mask, &info, &timeout) == -1) {
+            fprintf(stderr, "No reply from %d. Cause: %s\n", pid,
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    } while (info.si_pid != pid);
+
+    uint64_t reply = (uintptr_t)info.si_value.sival_ptr;
+    unsigned long delivered = reply >> 32;
+    uint64_t avg_latency = reply & UINT32_MAX;
+    printf("sent %ld in %.3f s (%.0f/s), rejected %ld\n", sent, elapsed,
+           sent / elapsed, rejected);
+    printf("delivered %lu, lost %ld\n", delivered, sent - (long)delivered);
+    printf("average latency %.1f us\n", avg_latency / 1e3);
+    return EXIT_SUCCESS;
+}
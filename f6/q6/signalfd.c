@@ -0,0 +1,186 @@
+/**
+ * Variant of `original.c` that does not install signal handlers. Handlers run
+ * asynchronously, so they cannot safely call `printf`. And standard signals
+ * are not queued, i.e., a burst of SIGUSR1 sent before the handler runs is
+ * seen as a single one.
+ *
+ * Instead, the signals are blocked and read from a `signalfd`, in batches, in
+ * a regular event loop where any function can be called. Real-time signals
+ * (SIGRTMIN to SIGRTMAX) are accepted as well. These are queued by the kernel,
+ * one entry per signal sent, together with the payload given to `sigqueue`,
+ * so none is lost.
+ *
+ * If the payload of a signal is a `CLOCK_MONOTONIC` timestamp in nanoseconds
+ * (see `sender.c`), the delivery latency is measured. When SIGRTMAX is
+ * received, the statistics since the previous SIGRTMAX are printed and sent
+ * back to the process that sent it.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Number of signals read from the signalfd with each `read` */
+#define BATCH 64
+
+/** Statistics of the signals received since the last report */
+struct stats {
+    unsigned long count[_NSIG]; // per signal number
+    unsigned long received;     // total
+    unsigned long timed;        // signals that carried a timestamp
+    uint64_t lat_min, lat_max, lat_sum; // latency, in nanoseconds
+};
+
+/**
+ * @brief Current time of the monotonic clock, in nanoseconds
+ */
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Prints the name of a signal, e.g. `SIGUSR1` or `SIGRTMIN+3`
+ *
+ * @param fp The output stream
+ * @param sig The signal number
+ */
+void print_signal(FILE *fp, int sig) {
+    if (sig >= SIGRTMIN && sig <= SIGRTMAX)
+        fprintf(fp, "SIGRTMIN+%d", sig - SIGRTMIN);
+    else
+        fprintf(fp, "SIG%s", sigabbrev_np(sig));
+}
+
+/**
+ * @brief Prints the statistics in stdout
+ *
+ * @param s The statistics
+ */
+void print_stats(const struct stats *s) {
+    printf("received %lu signals\n", s->received);
+    for (int sig = 1; sig < _NSIG; sig++) {
+        if (s->count[sig] == 0)
+            continue;
+        printf("  ");
+        print_signal(stdout, sig);
+        printf(": %lu\n", s->count[sig]);
+    }
+    if (s->timed > 0) {
+        printf("latency (us): min %.1f, avg %.1f, max %.1f\n",
+               s->lat_min / 1e3, s->lat_sum / 1e3 / s->timed,
+               s->lat_max / 1e3);
+    }
+    fflush(stdout);
+}
+
+/**
+ * @brief Sends the statistics to the process that requested them, packed in
+ * the payload of SIGRTMAX: received count in the high 32 bits and the average
+ * latency, in nanoseconds, in the low 32 bits
+ *
+ * @param pid The process to reply to
+ * @param s The statistics
+ */
+void reply_stats(pid_t pid, const struct stats *s) {
+    uint64_t avg = s->timed > 0 ? s->lat_sum / s->timed : 0;
+    if (avg > UINT32_MAX)
+        avg = UINT32_MAX;
+    uint64_t received = s->received > UINT32_MAX ? UINT32_MAX : s->received;
+    union sigval value = {.sival_ptr = (void *)(uintptr_t)(received << 32 | avg)};
+    if (sigqueue(pid, SIGRTMAX, value) == -1) {
+        fprintf(stderr, "Failed to reply to %d. Cause: %s\n", pid,
+                strerror(errno));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    /* -q skips the line printed for each signal, for high rates */
+    int quiet = argc == 2 && strcmp(argv[1], "-q") == 0;
+    if (argc > 2 || (argc == 2 && !quiet)) {
+        fprintf(stderr, "Usage: %s [-q]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* block the signals, so that they stay pending until read */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGUSR2);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    for (int sig = SIGRTMIN; sig <= SIGRTMAX; sig++)
+        sigaddset(&mask, sig);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+        fprintf(stderr, "Can't block signals: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (sfd == -1) {
+        fprintf(stderr, "Can't create signalfd: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    printf("My PID is %d\n", getpid());
+    fflush(stdout);
+
+    /* event loop */
+    struct stats stats = {.lat_min = UINT64_MAX};
+    struct signalfd_siginfo batch[BATCH];
+    for (;;) {
+        ssize_t bytes = read(sfd, batch, sizeof(batch));
+        if (bytes == -1) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Can't read signalfd: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        uint64_t now = now_ns();
+
+        for (size_t i = 0; i < bytes / sizeof(batch[0]); i++) {
+            struct signalfd_siginfo *si = &batch[i];
+            int sig = si->ssi_signo;
+
+            if (sig == SIGINT || sig == SIGTERM) {
+                print_stats(&stats);
+                close(sfd);
+                exit(EXIT_SUCCESS);
+            }
+            if (sig == SIGRTMAX) { // report request
+                print_stats(&stats);
+                reply_stats(si->ssi_pid, &stats);
+                memset(&stats, 0, sizeof(stats));
+                stats.lat_min = UINT64_MAX;
+                continue;
+            }
+
+            stats.count[sig]++;
+            stats.received++;
+            // payloads sent with sigqueue carry the send time
+            if (si->ssi_code == SI_QUEUE && si->ssi_ptr != 0 &&
+                si->ssi_ptr <= now) {
+                uint64_t lat = now - si->ssi_ptr;
+                stats.timed++;
+                stats.lat_sum += lat;
+                if (lat < stats.lat_min)
+                    stats.lat_min = lat;
+                if (lat > stats.lat_max)
+                    stats.lat_max = lat;
+            }
+            if (!quiet) {
+                printf("received ");
+                print_signal(stdout, sig);
+                printf(" from %u\n", si->ssi_pid);
+            }
+        }
+    }
+}
@@ -0,0 +1,415 @@
+/**
+ * Scalability benchmark of the ways to count from many threads, the problem
+ * of `q1` and `q2`: each thread increments a shared count `iterations` times.
+ *
+ * Strategies:
+ *  - racy:      `count++` without synchronization (`q1/original.c`)
+ *  - mutex:     a mutex around each increment (`q2/naive.c`)
+ *  - coarse:    a mutex around the whole loop (`q2/original.c`)
+ *  - reduction: a private count, added under the mutex (`q2/reduction.c`)
+ *  - atomic:    atomic fetch-and-add on the shared count
+ *  - padded:    a private count per thread in its own cache line, updated
+ *               with relaxed atomics and summed at the end
+ *  - spinlock:  a test-and-test-and-set spinlock around each increment
+ *  - ticket:    a FIFO ticket lock around each increment
+ *  - sharded-cpu, sharded-thread: the sharded counter of `lib/counter.h`
+ *  - amutex:    the adaptive futex mutex of `lib/lock.h` around each increment
+ *  - mcs:       the MCS queue lock of `lib/lock.h` around each increment
+ *
+ * Every combination of the given strategies and thread counts is run. The
+ * threads start together on a barrier, and the time is measured from the
+ * first one to start to the last one to finish (by the threads themselves,
+ * since the main thread may not be running when they start). The results are
+ * printed as JSON in stdout (a table in stderr): ns/op is the time of each
+ * thread per increment, ops/s the total throughput, and `correct` whether the
+ * final count is threads * iterations.
+ *
+ * With `-a policy`, thread `i` pins itself with the policy of
+ * `lib/placement.h` before the barrier (compact, scatter, node); the policy
+ * and the topology are recorded with the results.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../lib/counter.h"
+#include "../lib/lock.h"
+#include "../lib/placement.h"
+#include "../lib/spin.h"
+
+#define MAX_THREADS 256
+#define MAX_RUNS 64
+
+struct worker {
+    pthread_t tid;
+    int id;
+    long iterations;
+    double start, end; // taken by the thread itself
+};
+
+struct strategy {
+    const char *name;
+    void (*inc)(struct worker *w); // body of each thread
+    long (*result)(int nthreads);  // final count
+};
+
+/* ------ shared state of every strategy, reset before each run ------ */
+static volatile long racy_count;
+static long count;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_long atomic_count;
+static struct slot {
+    _Alignas(CACHE_LINE) atomic_long value;
+} slots[MAX_THREADS];
+static struct spinlock spin;
+static struct ticket_lock ticket;
+static struct counter sharded_cpu, sharded_thread;
+static struct amutex amutex;
+static struct mcs_lock mcs;
+
+static pthread_barrier_t start_barrier;
+
+static void reset() {
+    racy_count = 0;
+    count = 0;
+    atomic_store(&atomic_count, 0);
+    for (int i = 0; i < MAX_THREADS; i++)
+        atomic_store(&slots[i].value, 0);
+    spin = (struct spinlock)SPINLOCK_INITIALIZER;
+    ticket = (struct ticket_lock)TICKET_LOCK_INITIALIZER;
+    amutex_init(&amutex);
+    mcs = (struct mcs_lock)MCS_LOCK_INITIALIZER;
+    counter_destroy(&sharded_cpu);
+    counter_destroy(&sharded_thread);
+    if (counter_init(&sharded_cpu, COUNTER_PER_CPU, 0) == -1 ||
+        counter_init(&sharded_thread, COUNTER_PER_THREAD, 0) == -1) {
+        perror("counter_init");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* ------ strategies ------ */
+static void inc_racy(struct worker *w) {
+    for (long i = 0; i < w->iterations; i++)
+        racy_count++;
+}
+
+static void inc_mutex(struct worker *w) {
+    for (long i = 0; i < w->iterations; i++) {
+        pthread_mutex_lock(&lock);
+        count++;
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+static void inc_coarse(struct worker *w) {
+    pthread_mutex_lock(&lock);
+    for (long i = 0; i < w->iterations; i++)
+        count++;
+    pthread_mutex_unlock(&lock);
+}
+
+static void inc_reduction(struct worker *w) {
+    long my_count = 0;
+    for (long i = 0; i < w->iterations; i++)
+        my_count++;
+    pthread_mutex_lock(&lock);
+    count += my_count;
+    pthread_mutex_unlock(&lock);
+}
+
+static void inc_atomic(struct worker *w) {
+    for (long i = 0; i < w->iterations; i++)
+        atomic_fetch_add_explicit(&atomic_count, 1, memory_order_relaxed);
+}
+
+static void inc_padded(struct worker *w) {
+    // only this thread writes its slot: a plain load and store, no lock prefix
+    atomic_long *slot = &slots[w->id].value;
+    for (long i = 0; i < w->iterations; i++)
+        atomic_store_explicit(
+            slot, atomic_load_explicit(slot, memory_order_relaxed) + 1,
+            memory_order_relaxed);
+}
+
+static void inc_spinlock(struct worker *w) {
+    for (long i = 0; i < w->iterations; i++) {
+        spin_lock(&spin);
+        count++;
+        spin_unlock(&spin);
+    }
+}
+
+static void inc_ticket(struct worker *w) {
+    for (long i = 0; i < w->iterations; i++) {
+        ticket_lock(&ticket);
+        count++;
+        ticket_unlock(&ticket);
+    }
+}
+
+static void inc_sharded_cpu(struct worker *w) {
+    for (long i = 0; i < w->iterations; i++)
+        counter_inc(&sharded_cpu);
+}
+
+static void inc_sharded_thread(struct worker *w) {
+    for (long i = 0; i < w->iterations; i++)
+        counter_inc(&sharded_thread);
+}
+
+static void inc_amutex(struct worker *w) {
+    for (long i = 0; i < w->iterations; i++) {
+        amutex_lock(&amutex);
+        count++;
+        amutex_unlock(&amutex);
+    }
+}
+
+static void inc_mcs(struct worker *w) {
+    struct mcs_node node;
+    for (long i = 0; i < w->iterations; i++) {
+        mcs_lock(&mcs, &node);
+        count++;
+        mcs_unlock(&mcs, &node);
+    }
+}
+
+static long result_racy(int nthreads) {
+    (void)nthreads;
+    return racy_count;
+}
+
+static long result_count(int nthreads) {
+    (void)nthreads;
+    return count;
+}
+
+static long result_atomic(int nthreads) {
+    (void)nthreads;
+    return atomic_load(&atomic_count);
+}
+
+static long result_slots(int nthreads) {
+    long sum = 0;
+    for (int i = 0; i < nthreads; i++)
+        sum += atomic_load(&slots[i].value);
+    return sum;
+}
+
+static long result_sharded_cpu(int nthreads) {
+    (void)nthreads;
+    return counter_read(&sharded_cpu);
+}
+
+static long result_sharded_thread(int nthreads) {
+    (void)nthreads;
+    return counter_read(&sharded_thread);
+}
+
+static const struct strategy strategies[] = {
+    {"racy", inc_racy, result_racy},
+    {"mutex", inc_mutex, result_count},
+    {"coarse", inc_coarse, result_count},
+    {"reduction", inc_reduction, result_count},
+    {"atomic", inc_atomic, result_atomic},
+    {"padded", inc_padded, result_slots},
+    {"spinlock", inc_spinlock, result_count},
+    {"ticket", inc_ticket, result_count},
+    {"sharded-cpu", inc_sharded_cpu, result_sharded_cpu},
+    {"sharded-thread", inc_sharded_thread, result_sharded_thread},
+    {"amutex", inc_amutex, result_count},
+    {"mcs", inc_mcs, result_count},
+};
+#define NSTRATEGIES (int)(sizeof(strategies) / sizeof(strategies[0]))
+
+static const struct strategy *current;
+
+/**
+ * @brief Current time of the monotonic clock, in seconds
+ */
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void *thread_main(void *arg) {
+    struct worker *w = arg;
+    if (placement_apply(w->id) == -1)
+        perror("placement_apply");
+    pthread_barrier_wait(&start_barrier);
+    w->start = now();
+    current->inc(w);
+    w->end = now();
+    return NULL;
+}
+
+/**
+ * @brief Runs a strategy with `nthreads` threads. Exits on failure
+ *
+ * @return The elapsed time, in seconds
+ */
+double run(const struct strategy *s, int nthreads, long iterations) {
+    struct worker workers[MAX_THREADS];
+    reset();
+    current = s;
+    pthread_barrier_init(&start_barrier, NULL, nthreads + 1);
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].id = i;
+        workers[i].iterations = iterations;
+        int err =
+            pthread_create(&workers[i].tid, NULL, thread_main, &workers[i]);
+        if (err != 0) {
+            fprintf(stderr, "Failed to create thread. Cause: %s\n",
+                    strerror(err));
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_barrier_wait(&start_barrier);
+    double start = 0, end = 0;
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(workers[i].tid, NULL);
+        if (i == 0 || workers[i].start < start)
+            start = workers[i].start;
+        if (workers[i].end > end)
+            end = workers[i].end;
+    }
+    pthread_barrier_destroy(&start_barrier);
+    return end - start;
+}
+
+/**
+ * @brief Parses a comma-separated list of thread counts
+ *
+ * @return The number of elements, or -1 if invalid
+ */
+int parse_threads(char *list, int *out) {
+    int n = 0;
+    for (char *tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        int t = atoi(tok);
+        if (t <= 0 || t > MAX_THREADS || n == MAX_RUNS)
+            return -1;
+        out[n++] = t;
+    }
+    return n;
+}
+
+/**
+ * @brief Parses a comma-separated list of strategy names, or `all`
+ *
+ * @return The number of elements, or -1 if a name is unknown
+ */
+int parse_strategies(char *list, const struct strategy **out) {
+    if (strcmp(list, "all") == 0) {
+        for (int i = 0; i < NSTRATEGIES; i++)
+            out[i] = &strategies[i];
+        return NSTRATEGIES;
+    }
+    int n = 0;
+    for (char *tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        int i = 0;
+        while (i < NSTRATEGIES && strcmp(strategies[i].name, tok) != 0)
+            i++;
+        if (i == NSTRATEGIES || n == MAX_RUNS)
+            return -1;
+        out[n++] = &strategies[i];
+    }
+    return n;
+}
+
+void usage(char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-s strategies] [-t threads] [-n iterations] "
+            "[-a policy]\n"
+            "  -s  comma-separated list, or all (default)\n"
+            "  -t  comma-separated thread counts (default 1,2,4,8)\n"
+            "  -n  increments per thread (default 1000000)\n"
+            "  -a  pin the threads: none (default), compact, scatter or node\n"
+            "Strategies:",
+            prog);
+    for (int i = 0; i < NSTRATEGIES; i++)
+        fprintf(stderr, " %s", strategies[i].name);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    const struct strategy *selected[MAX_RUNS];
+    int threads[MAX_RUNS] = {1, 2, 4, 8};
+    int nselected = -1, nthreads = 4, policy = PLACE_NONE;
+    long iterations = 1000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:n:a:")) != -1) {
+        switch (opt) {
+            case 's':
+                if ((nselected = parse_strategies(optarg, selected)) <= 0)
+                    usage(argv[0]);
+                break;
+            case 't':
+                if ((nthreads = parse_threads(optarg, threads)) <= 0)
+                    usage(argv[0]);
+                break;
+            case 'n':
+                if ((iterations = atol(optarg)) <= 0)
+                    usage(argv[0]);
+                break;
+            case 'a':
+                if ((policy = placement_parse(optarg)) == -1)
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc)
+        usage(argv[0]);
+    if (nselected == -1)
+        nselected = parse_strategies("all", selected);
+
+    // the topology is read even without pinning, to record it
+    if (placement_set(policy) == -1) {
+        fprintf(stderr, "Failed to read the topology. Cause: %s\n",
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+    const struct topology *topo = placement_topology();
+    printf("{\n  \"iterations\": %ld,\n  \"cpus\": %ld,\n  \"placement\": "
+           "\"%s\",\n  \"topology\": {\"cpus\": %d, \"cores\": %d, "
+           "\"nodes\": %d},\n  \"results\": [",
+           iterations, sysconf(_SC_NPROCESSORS_ONLN), placement_name(policy),
+           topo->ncpus, topo->ncores, topo->nnodes);
+    fprintf(stderr, "placement %s: %d cpus, %d cores, %d nodes\n",
+            placement_name(policy), topo->ncpus, topo->ncores, topo->nnodes);
+    fprintf(stderr, "%-14s %7s %10s %14s %14s %7s\n", "strategy", "threads",
+            "ns/op", "ops/s", "count", "correct");
+    int first = 1;
+    for (int i = 0; i < nselected; i++) {
+        for (int j = 0; j < nthreads; j++) {
+            double elapsed = run(selected[i], threads[j], iterations);
+            long expected = threads[j] * iterations;
+            long got = selected[i]->result(threads[j]);
+            double ns_per_op = elapsed * 1e9 / iterations;
+            double ops_per_s = expected / elapsed;
+            printf("%s\n    {\"strategy\": \"%s\", \"threads\": %d, "
+                   "\"elapsed_s\": %.6f, \"ns_per_op\": %.3f, "
+                   "\"ops_per_s\": %.0f, \"expected\": %ld, \"count\": %ld, "
+                   "\"correct\": %s}",
+                   first ? "" : ",", selected[i]->name, threads[j], elapsed,
+                   ns_per_op, ops_per_s, expected, got,
+                   got == expected ? "true" : "false");
+            fprintf(stderr, "%-14s %7d %10.2f %14.0f %14ld %7s\n",
+                    selected[i]->name, threads[j], ns_per_op, ops_per_s, got,
+                    got == expected ? "yes" : "NO");
+            fflush(stdout);
+            first = 0;
+        }
+    }
+    printf("\n  ]\n}\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+/**
+ * Replaces `pthread_mutex_t` with `struct amutex` (see `lock.h`) in a program
+ * that only locks and unlocks mutexes, without changing its source:
+ *
+ *     gcc -include lib/amutex_swap.h q2/naive.c lib/lock.c
+ *
+ * `pthread.h` is included first, so that its declarations are not renamed.
+ * Mutex attributes are ignored, and the mutexes must not be used with
+ * condition variables.
+ */
+#ifndef AMUTEX_SWAP_H
+#define AMUTEX_SWAP_H
+
+#include <pthread.h>
+
+#include "lock.h"
+
+static inline int amutex_swap_init(struct amutex *m, const void *attr) {
+    (void)attr;
+    amutex_init(m);
+    return 0;
+}
+
+static inline int amutex_swap_destroy(struct amutex *m) {
+    amutex_destroy(m);
+    return 0;
+}
+
+static inline int amutex_swap_lock(struct amutex *m) {
+    amutex_lock(m);
+    return 0;
+}
+
+static inline int amutex_swap_unlock(struct amutex *m) {
+    amutex_unlock(m);
+    return 0;
+}
+
+#undef PTHREAD_MUTEX_INITIALIZER
+#define PTHREAD_MUTEX_INITIALIZER AMUTEX_INITIALIZER
+#define pthread_mutex_t struct amutex
+#define pthread_mutex_init amutex_swap_init
+#define pthread_mutex_destroy amutex_swap_destroy
+#define pthread_mutex_lock amutex_swap_lock
+#define pthread_mutex_unlock amutex_swap_unlock
+
+#endif
@@ -0,0 +1,92 @@
+#define _GNU_SOURCE // sched_getcpu
+
+#include "counter.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define WORD_BITS 64
+
+_Thread_local int counter_tid = -1;
+
+/** Thread indexes in use, released when their thread exits */
+static atomic_ulong used[COUNTER_MAX_THREADS / WORD_BITS];
+static pthread_key_t release_key;
+static pthread_once_t release_once = PTHREAD_ONCE_INIT;
+
+static void release_tid(void *arg) {
+    int id = (intptr_t)arg - 1;
+    atomic_fetch_and(&used[id / WORD_BITS], ~(1ul << (id % WORD_BITS)));
+}
+
+static void make_release_key(void) {
+    pthread_key_create(&release_key, release_tid);
+}
+
+int counter_init(struct counter *c, int mode, long batch) {
+    memset(c, 0, sizeof(*c));
+    c->mode = mode;
+    c->batch = batch;
+    c->nslots = mode == COUNTER_PER_CPU ? sysconf(_SC_NPROCESSORS_CONF)
+                                        : COUNTER_MAX_THREADS;
+    if (c->nslots <= 0)
+        c->nslots = 1;
+    c->slots = aligned_alloc(CACHE_LINE, c->nslots * sizeof(*c->slots));
+    if (c->slots == NULL)
+        return -1;
+    for (int i = 0; i < c->nslots; i++)
+        atomic_init(&c->slots[i].value, 0);
+    atomic_init(&c->total, 0);
+    return 0;
+}
+
+void counter_destroy(struct counter *c) {
+    free(c->slots);
+    c->slots = NULL;
+}
+
+long counter_read(struct counter *c) {
+    long sum = atomic_load_explicit(&c->total, memory_order_relaxed);
+    for (int i = 0; i < c->nslots; i++)
+        sum += atomic_load_explicit(&c->slots[i].value, memory_order_relaxed);
+    return sum;
+}
+
+int counter_thread_id(void) {
+    if (counter_tid >= 0)
+        return counter_tid;
+    // claim the lowest free index, so that short-lived threads reuse them
+    pthread_once(&release_once, make_release_key);
+    for (int w = 0; w < COUNTER_MAX_THREADS / WORD_BITS; w++) {
+        unsigned long bits = atomic_load(&used[w]);
+        while (~bits != 0) {
+            int bit = __builtin_ctzl(~bits);
+            if (atomic_compare_exchange_weak(&used[w], &bits,
+                                             bits | (1ul << bit))) {
+                counter_tid = w * WORD_BITS + bit;
+                // released by the destructor of the key when the thread exits
+                pthread_setspecific(release_key,
+                                    (void *)(intptr_t)(counter_tid + 1));
+                return counter_tid;
+            }
+        }
+    }
+    // all in use, the thread has no slot of its own
+    counter_tid = COUNTER_MAX_THREADS;
+    return counter_tid;
+}
+
+void counter_fold(struct counter *c, struct counter_slot *s) {
+    // for an exclusive slot, nobody else writes it between these two
+    long v = atomic_exchange_explicit(&s->value, 0, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->total, v, memory_order_relaxed);
+}
+
+int counter_getcpu(void) {
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : cpu;
+}
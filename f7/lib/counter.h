@@ -0,0 +1,149 @@
+/**
+ * Sharded counter, for counts updated from many threads.
+ *
+ * Instead of a single word that every thread writes (and whose cache line
+ * bounces between cores), the counter has one slot per CPU or per thread, each
+ * in its own cache line. Increments go to the caller's slot; reads sum them.
+ *
+ * - `COUNTER_PER_CPU`: the slot of the CPU the thread runs on, found with
+ *   `rseq` (a load from the area the kernel keeps up to date, glibc >= 2.35)
+ *   or `sched_getcpu` otherwise. The thread may migrate between finding the
+ *   slot and updating it, so the update is an atomic add, but it is almost
+ *   never contended.
+ * - `COUNTER_PER_THREAD`: a slot per thread, up to `COUNTER_MAX_THREADS`
+ *   live threads (indexes are reused after a thread exits), so it is updated
+ *   with a plain load and store. Threads beyond that add atomically to the
+ *   total.
+ *
+ * With a non-zero `batch`, a slot whose value reaches `batch` is folded into
+ * a global total. `counter_read_approx` reads only that total, a single load,
+ * off by less than `nslots * batch`. `counter_read` sums every slot, and is
+ * exact when no update is in flight.
+ */
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <stdatomic.h>
+
+#if defined(__GLIBC__) && __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#define COUNTER_HAVE_RSEQ 1
+#endif
+
+#ifndef CACHE_LINE
+#define CACHE_LINE 64
+#endif
+/** Slots of a per-thread counter */
+#define COUNTER_MAX_THREADS 256
+
+enum counter_mode {
+    COUNTER_PER_CPU,
+    COUNTER_PER_THREAD,
+};
+
+struct counter_slot {
+    _Alignas(CACHE_LINE) atomic_long value;
+};
+
+struct counter {
+    _Alignas(CACHE_LINE) atomic_long total; // folded slots
+    int mode;
+    int nslots;
+    long batch; // fold slots at this value, 0 to never fold
+    struct counter_slot *slots;
+};
+
+/** Index of the calling thread, -1 until `counter_thread_id` assigns it */
+extern _Thread_local int counter_tid;
+
+/**
+ * @brief Initializes a counter to 0
+ *
+ * @param c The counter
+ * @param mode `COUNTER_PER_CPU` or `COUNTER_PER_THREAD`
+ * @param batch Slots are folded into the total when they reach this value, 0
+ * to never fold (then `counter_read_approx` is always 0)
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+int counter_init(struct counter *c, int mode, long batch);
+
+/**
+ * @brief Frees the slots of a counter
+ */
+void counter_destroy(struct counter *c);
+
+/**
+ * @brief Sum of the total and every slot
+ */
+long counter_read(struct counter *c);
+
+/**
+ * @brief Index of the calling thread, assigned on its first call. Indexes
+ * below `COUNTER_MAX_THREADS` are unique among live threads
+ */
+int counter_thread_id(void);
+
+/**
+ * @brief Moves the value of a slot to the total
+ */
+void counter_fold(struct counter *c, struct counter_slot *s);
+
+/**
+ * @brief The CPU the calling thread runs on, with `sched_getcpu`
+ */
+int counter_getcpu(void);
+
+/**
+ * @brief The total only, off by less than `nslots * batch`
+ */
+static inline long counter_read_approx(struct counter *c) {
+    return atomic_load_explicit(&c->total, memory_order_relaxed);
+}
+
+/**
+ * @brief The CPU the calling thread runs on
+ */
+static inline int counter_cpu(void) {
+#ifdef COUNTER_HAVE_RSEQ
+    if (__rseq_size > 0) {
+        const volatile struct rseq *rs =
+            (const struct rseq *)((char *)__builtin_thread_pointer() +
+                                  __rseq_offset);
+        int cpu = (int)rs->cpu_id;
+        if (cpu >= 0)
+            return cpu;
+    }
+#endif
+    return counter_getcpu();
+}
+
+/**
+ * @brief Adds `n` to the counter
+ */
+static inline void counter_add(struct counter *c, long n) {
+    struct counter_slot *s;
+    long v;
+    if (c->mode == COUNTER_PER_THREAD) {
+        int id = counter_tid >= 0 ? counter_tid : counter_thread_id();
+        if (id >= c->nslots) {
+            atomic_fetch_add_explicit(&c->total, n, memory_order_relaxed);
+            return;
+        }
+        // the only writer of the slot, no read-modify-write needed
+        s = &c->slots[id];
+        v = atomic_load_explicit(&s->value, memory_order_relaxed) + n;
+        atomic_store_explicit(&s->value, v, memory_order_relaxed);
+    } else {
+        s = &c->slots[counter_cpu() % c->nslots];
+        v = atomic_fetch_add_explicit(&s->value, n, memory_order_relaxed) + n;
+    }
+    if (c->batch > 0 && (v >= c->batch || v <= -c->batch))
+        counter_fold(c, s);
+}
+
+static inline void counter_inc(struct counter *c) {
+    counter_add(c, 1);
+}
+
+#endif
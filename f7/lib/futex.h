@@ -0,0 +1,72 @@
+/**
+ * Thin wrappers around the futex system call, for the locks and queues that
+ * park their waiters in the kernel instead of spinning.
+ *
+ * A futex is a 32-bit word: `futex_wait` sleeps only if the word still holds
+ * the expected value (checked atomically by the kernel), and `futex_wake`
+ * wakes threads sleeping on it. Process-private, since every user is a thread
+ * of the same process.
+ */
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief Sleeps while `*word == expected`, until woken
+ *
+ * @retval -1 - The word did not hold `expected` (`EAGAIN`), or interrupted
+ * @retval 0 - Woken (possibly spuriously, recheck the condition)
+ */
+static inline int futex_wait(atomic_uint *word, unsigned expected) {
+    return syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL,
+                   0) == -1
+               ? -1
+               : 0;
+}
+
+/**
+ * @brief Wakes up to `n` threads sleeping on `word`
+ *
+ * @return The number of threads woken
+ */
+static inline int futex_wake(atomic_uint *word, int n) {
+    return syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/**
+ * @brief Like `futex_wait`, but only woken by `futex_wake_bitset` with a
+ * bitset that shares a bit with `bits`
+ */
+static inline int futex_wait_bitset(atomic_uint *word, unsigned expected,
+                                    unsigned bits) {
+    return syscall(SYS_futex, word, FUTEX_WAIT_BITSET_PRIVATE, expected, NULL,
+                   NULL, bits) == -1
+               ? -1
+               : 0;
+}
+
+/**
+ * @brief Wakes up to `n` threads sleeping on `word` with a bitset that shares
+ * a bit with `bits`
+ *
+ * @return The number of threads woken
+ */
+static inline int futex_wake_bitset(atomic_uint *word, int n, unsigned bits) {
+    return syscall(SYS_futex, word, FUTEX_WAKE_BITSET_PRIVATE, n, NULL, NULL,
+                   bits);
+}
+
+/**
+ * @brief Wakes every thread sleeping on `word`
+ */
+static inline int futex_wake_all(atomic_uint *word) {
+    return futex_wake(word, INT_MAX);
+}
+
+#endif
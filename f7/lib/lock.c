@@ -0,0 +1,134 @@
+#include "lock.h"
+
+#include <limits.h>
+#include <unistd.h>
+
+#include "futex.h"
+
+/** Bits of the futex bitsets, parked tickets are spread over them */
+#define TURN_BITS 32
+
+unsigned lock_spin_budget(unsigned avg) {
+    static atomic_int cpus;
+    int n = atomic_load_explicit(&cpus, memory_order_relaxed);
+    if (n == 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        atomic_store_explicit(&cpus, n, memory_order_relaxed);
+    }
+    if (n <= 1)
+        return 0;
+    unsigned budget = 2 * avg + 16;
+    return budget < SPIN_LIMIT ? budget : SPIN_LIMIT;
+}
+
+void amutex_init(struct amutex *m) {
+    *m = (struct amutex)AMUTEX_INITIALIZER;
+}
+
+void amutex_destroy(struct amutex *m) {
+    (void)m;
+}
+
+/**
+ * @brief Adds a sample to the moving average of the spins, weight 1/8
+ */
+static void update_spins(struct amutex *m, unsigned spins) {
+    unsigned avg = atomic_load_explicit(&m->spins, memory_order_relaxed);
+    // racy among waiters, but it is only a hint
+    atomic_store_explicit(&m->spins, avg + ((int)(spins - avg) / 8),
+                          memory_order_relaxed);
+}
+
+void amutex_lock_slow(struct amutex *m) {
+    /* ------ spin, while the lock is likely to be released soon ------ */
+    unsigned budget =
+        lock_spin_budget(atomic_load_explicit(&m->spins, memory_order_relaxed));
+    for (unsigned i = 0; i < budget; i++) {
+        unsigned c = atomic_load_explicit(&m->state, memory_order_relaxed);
+        if (c == 0 && atomic_compare_exchange_weak_explicit(
+                          &m->state, &c, 1, memory_order_acquire,
+                          memory_order_relaxed)) {
+            update_spins(m, i);
+            return;
+        }
+        cpu_relax();
+    }
+    if (budget > 0)
+        update_spins(m, budget);
+
+    /* ------ park, in the order of the tickets, until at the head ------ */
+    unsigned ticket = atomic_fetch_add(&m->next, 1);
+    unsigned turn;
+    while ((turn = atomic_load(&m->turn)) != ticket)
+        futex_wait_bitset(&m->turn, turn, 1u << (ticket % TURN_BITS));
+
+    /* ------ the head sleeps on the lock itself ------ */
+    for (;;) {
+        unsigned c = 0;
+        if (atomic_compare_exchange_strong_explicit(&m->state, &c, 1,
+                                                    memory_order_acquire,
+                                                    memory_order_relaxed))
+            break;
+        // tell the owner to wake it, then sleep until the lock changes
+        if (c == 1 && !atomic_compare_exchange_strong_explicit(
+                          &m->state, &c, 2, memory_order_relaxed,
+                          memory_order_relaxed))
+            continue;
+        futex_wait(&m->state, 2);
+    }
+
+    /* ------ the next parked waiter, if any, becomes the head ------ */
+    atomic_store(&m->turn, ticket + 1);
+    // pairs with the ticket taken: either it sees the turn, or this sees it
+    if (atomic_load(&m->next) != ticket + 1)
+        futex_wake_bitset(&m->turn, INT_MAX,
+                          1u << ((ticket + 1) % TURN_BITS));
+}
+
+void amutex_wake(struct amutex *m) {
+    futex_wake(&m->state, 1);
+}
+
+void mcs_lock(struct mcs_lock *l, struct mcs_node *me) {
+    atomic_store_explicit(&me->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&me->wait, 1, memory_order_relaxed);
+    struct mcs_node *prev =
+        atomic_exchange_explicit(&l->tail, me, memory_order_acq_rel);
+    if (prev == NULL)
+        return; // the lock was free
+    atomic_store_explicit(&prev->next, me, memory_order_release);
+
+    unsigned budget = lock_spin_budget(SPIN_LIMIT);
+    for (unsigned i = 0; i < budget; i++) {
+        if (atomic_load_explicit(&me->wait, memory_order_acquire) == 0)
+            return;
+        cpu_relax();
+    }
+    unsigned w = 1;
+    if (!atomic_compare_exchange_strong_explicit(&me->wait, &w, 2,
+                                                 memory_order_acquire,
+                                                 memory_order_acquire))
+        return; // handed over meanwhile
+    while (atomic_load_explicit(&me->wait, memory_order_acquire) != 0)
+        futex_wait(&me->wait, 2);
+}
+
+void mcs_unlock(struct mcs_lock *l, struct mcs_node *me) {
+    struct mcs_node *next =
+        atomic_load_explicit(&me->next, memory_order_acquire);
+    if (next == NULL) {
+        struct mcs_node *expected = me;
+        if (atomic_compare_exchange_strong_explicit(&l->tail, &expected, NULL,
+                                                    memory_order_release,
+                                                    memory_order_relaxed))
+            return; // nobody waiting
+        // a waiter swapped the tail but has not linked itself yet
+        unsigned spins = 0;
+        while ((next = atomic_load_explicit(&me->next,
+                                            memory_order_acquire)) == NULL)
+            spin_wait(&spins);
+    }
+    // the node may be gone once 'wait' is 0, a stale wake-up is harmless
+    if (atomic_exchange_explicit(&next->wait, 0, memory_order_release) == 2)
+        futex_wake(&next->wait, 1);
+}
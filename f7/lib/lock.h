@@ -0,0 +1,79 @@
+/**
+ * Sleeping locks built directly on futexes, for short critical sections.
+ *
+ * `struct amutex` is a drop-in for `pthread_mutex_t` (see `amutex_swap.h`).
+ * The uncontended path is a single compare-and-swap. Under contention, a
+ * waiter first spins, for about twice the number of iterations that recent
+ * waiters needed to see the lock released (a moving average, the hold time of
+ * the lock measured in spins), up to `SPIN_LIMIT`. If that is not enough, it
+ * parks. Parked waiters are served in FIFO order: they take a ticket, and
+ * only the oldest one (the head) sleeps on the lock itself, the others sleep
+ * until it is their turn to be the head. A running thread may still take the
+ * lock before a head that was just woken up (barging), which keeps the lock
+ * busy instead of waiting for the head to be scheduled.
+ *
+ * `struct mcs_lock` is a queue lock (Mellor-Crummey and Scott): each waiter
+ * spins on its own node, in its own cache line, and the owner hands the lock
+ * to the next node when releasing it. So there is no cache line that every
+ * waiter polls, and the lock is strictly FIFO. After spinning, a waiter sleeps
+ * on a futex in its node. The caller provides the node, one per thread and
+ * lock held, valid until the unlock.
+ *
+ * With a single CPU online, neither spins: the owner cannot run meanwhile.
+ */
+#ifndef LOCK_H
+#define LOCK_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "spin.h"
+
+struct amutex {
+    atomic_uint state; // 0 free, 1 locked, 2 locked and the head asleep
+    atomic_uint spins; // moving average of the spins to acquire
+    atomic_uint next;  // next ticket of the parking queue
+    atomic_uint turn;  // futex, ticket of the head
+};
+
+#define AMUTEX_INITIALIZER {0, 0, 0, 0}
+
+struct mcs_node {
+    _Alignas(CACHE_LINE) _Atomic(struct mcs_node *) next;
+    atomic_uint wait; // futex, 1 waiting, 2 asleep, 0 owner
+};
+
+struct mcs_lock {
+    _Atomic(struct mcs_node *) tail; // last waiter, NULL if free
+};
+
+#define MCS_LOCK_INITIALIZER {NULL}
+
+/**
+ * @brief Iterations to spin before parking, 0 with a single CPU
+ *
+ * @param avg The moving average of the spins to acquire the lock
+ */
+unsigned lock_spin_budget(unsigned avg);
+
+void amutex_init(struct amutex *m);
+void amutex_destroy(struct amutex *m);
+void amutex_lock_slow(struct amutex *m);
+void amutex_wake(struct amutex *m);
+
+static inline void amutex_lock(struct amutex *m) {
+    unsigned c = 0;
+    if (!atomic_compare_exchange_strong_explicit(
+            &m->state, &c, 1, memory_order_acquire, memory_order_relaxed))
+        amutex_lock_slow(m);
+}
+
+static inline void amutex_unlock(struct amutex *m) {
+    if (atomic_exchange_explicit(&m->state, 0, memory_order_release) == 2)
+        amutex_wake(m);
+}
+
+void mcs_lock(struct mcs_lock *l, struct mcs_node *me);
+void mcs_unlock(struct mcs_lock *l, struct mcs_node *me);
+
+#endif
@@ -0,0 +1,165 @@
+#include "mpmc.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "futex.h"
+
+int mpmc_init(struct mpmc *q, size_t capacity) {
+    size_t cap = 2;
+    while (cap < capacity)
+        cap <<= 1;
+    q->cells = aligned_alloc(CACHE_LINE, cap * sizeof(*q->cells));
+    if (q->cells == NULL)
+        return -1;
+    for (size_t i = 0; i < cap; i++) {
+        atomic_init(&q->cells[i].seq, i);
+        q->cells[i].value = 0;
+    }
+    q->mask = cap - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->not_empty.epoch, 0);
+    atomic_init(&q->not_empty.sleepers, 0);
+    atomic_init(&q->not_full.epoch, 0);
+    atomic_init(&q->not_full.sleepers, 0);
+    q->spin_limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_LIMIT : 1;
+    return 0;
+}
+
+void mpmc_destroy(struct mpmc *q) {
+    free(q->cells);
+    q->cells = NULL;
+}
+
+/**
+ * @brief Claims up to `n` consecutive positions from `*pos`, the ones whose
+ * cell has the sequence `position + ready`
+ *
+ * @param pos `head` or `tail`
+ * @param ready 0 for producers (free cells), 1 for consumers (full cells)
+ * @param first Output, the first position claimed
+ * @return The number of positions claimed, 0 if none is ready
+ */
+static size_t claim(struct mpmc *q, atomic_size_t *pos, size_t ready,
+                    size_t n, size_t *first) {
+    size_t p = atomic_load_explicit(pos, memory_order_relaxed);
+    for (;;) {
+        size_t k = 0;
+        while (k < n) {
+            size_t seq = atomic_load_explicit(&q->cells[(p + k) & q->mask].seq,
+                                              memory_order_acquire);
+            if (seq != p + k + ready)
+                break;
+            k++;
+        }
+        if (k == 0) {
+            // not ready, unless another thread already took this position
+            size_t seq = atomic_load_explicit(&q->cells[p & q->mask].seq,
+                                              memory_order_acquire);
+            if ((ptrdiff_t)(seq - (p + ready)) < 0)
+                return 0; // full or empty
+            p = atomic_load_explicit(pos, memory_order_relaxed);
+            continue;
+        }
+        // on failure, 'p' is reloaded with the current position
+        if (atomic_compare_exchange_weak_explicit(pos, &p, p + k,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+            *first = p;
+            return k;
+        }
+    }
+}
+
+size_t mpmc_try_enqueue(struct mpmc *q, const long *items, size_t n) {
+    size_t first;
+    size_t k = claim(q, &q->head, 0, n, &first);
+    for (size_t i = 0; i < k; i++) {
+        struct mpmc_cell *c = &q->cells[(first + i) & q->mask];
+        c->value = items[i];
+        atomic_store_explicit(&c->seq, first + i + 1, memory_order_release);
+    }
+    return k;
+}
+
+size_t mpmc_try_dequeue(struct mpmc *q, long *items, size_t max) {
+    size_t first;
+    size_t k = claim(q, &q->tail, 1, max, &first);
+    for (size_t i = 0; i < k; i++) {
+        struct mpmc_cell *c = &q->cells[(first + i) & q->mask];
+        items[i] = c->value;
+        // free for the producer of the next round
+        atomic_store_explicit(&c->seq, first + i + q->mask + 1,
+                              memory_order_release);
+    }
+    return k;
+}
+
+/**
+ * @brief Wakes up to `n` threads sleeping in `w`, if there are any
+ */
+static void wake(struct mpmc_waiters *w, size_t n) {
+    // pairs with the fence in 'transfer': either the sleeper sees the cells
+    // just published, or this sees the sleeper
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&w->sleepers, memory_order_relaxed) > 0) {
+        atomic_fetch_add_explicit(&w->epoch, 1, memory_order_relaxed);
+        futex_wake(&w->epoch, n);
+    }
+}
+
+/**
+ * @brief Enqueues or dequeues at least one item, spinning and then sleeping
+ * in `w` while none can be
+ *
+ * @param enqueue Whether to enqueue `items`, or to dequeue into them
+ * @return The number of items moved
+ */
+static size_t transfer(struct mpmc *q, struct mpmc_waiters *w, int enqueue,
+                       long *items, size_t n) {
+    unsigned spins = 0;
+    for (;;) {
+        size_t k = enqueue ? mpmc_try_enqueue(q, items, n)
+                           : mpmc_try_dequeue(q, items, n);
+        if (k > 0)
+            return k;
+        if (++spins < q->spin_limit) {
+            cpu_relax();
+            continue;
+        }
+        if (spins == q->spin_limit) {
+            // let the other side run, on this CPU if there is only one
+            sched_yield();
+            continue;
+        }
+        // park: announce it, then try once more before sleeping
+        unsigned epoch = atomic_load_explicit(&w->epoch, memory_order_relaxed);
+        atomic_fetch_add_explicit(&w->sleepers, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        k = enqueue ? mpmc_try_enqueue(q, items, n)
+                    : mpmc_try_dequeue(q, items, n);
+        if (k == 0)
+            futex_wait(&w->epoch, epoch); // returns at once if it was bumped
+        atomic_fetch_sub_explicit(&w->sleepers, 1, memory_order_relaxed);
+        if (k > 0)
+            return k;
+        spins = 0;
+    }
+}
+
+void mpmc_enqueue(struct mpmc *q, const long *items, size_t n) {
+    for (size_t done = 0; done < n;) {
+        // not written when enqueuing, only typed for both directions
+        size_t k = transfer(q, &q->not_full, 1, (long *)items + done, n - done);
+        wake(&q->not_empty, k);
+        done += k;
+    }
+}
+
+size_t mpmc_dequeue(struct mpmc *q, long *items, size_t max) {
+    size_t k = transfer(q, &q->not_empty, 0, items, max);
+    wake(&q->not_full, k);
+    return k;
+}
@@ -0,0 +1,103 @@
+/**
+ * Bounded multi-producer/multi-consumer queue of `long`, lock-free (Dmitry
+ * Vyukov's ring of sequence numbers).
+ *
+ * Each cell has a sequence number that says whose turn it is: a cell at
+ * position `pos` is free for the producer of `pos` when its sequence is
+ * `pos`, and holds an item for the consumer of `pos` when it is `pos + 1`.
+ * Producers and consumers claim positions with a compare-and-swap on `head`
+ * and `tail`, which are in separate cache lines, and then own their cells
+ * until they publish the new sequence. Batches claim several consecutive
+ * cells with a single compare-and-swap.
+ *
+ * The non-blocking calls never wait. The blocking ones spin for a while when
+ * the queue is empty (consumers) or full (producers), and then sleep on a
+ * futex, one for each side. The other side only makes the `futex_wake` system
+ * call when some thread is asleep. With a single CPU online, they do not spin
+ * at all: the thread that would make progress cannot run meanwhile.
+ */
+#ifndef MPMC_H
+#define MPMC_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "spin.h"
+
+struct mpmc_cell {
+    atomic_size_t seq;
+    long value;
+};
+
+/** Threads sleeping until the queue is not empty, or not full */
+struct mpmc_waiters {
+    _Alignas(CACHE_LINE) atomic_uint epoch; // futex, bumped to wake
+    atomic_int sleepers;                    // parked, or about to
+};
+
+struct mpmc {
+    _Alignas(CACHE_LINE) atomic_size_t head; // next position to enqueue
+    _Alignas(CACHE_LINE) atomic_size_t tail; // next position to dequeue
+    struct mpmc_waiters not_empty;           // consumers
+    struct mpmc_waiters not_full;            // producers
+    _Alignas(CACHE_LINE) size_t mask;        // capacity - 1
+    unsigned spin_limit;                     // iterations before sleeping
+    struct mpmc_cell *cells;
+};
+
+/**
+ * @brief Initializes an empty queue
+ *
+ * @param q The queue
+ * @param capacity The number of cells, rounded up to a power of 2
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+int mpmc_init(struct mpmc *q, size_t capacity);
+
+/**
+ * @brief Frees the cells of a queue
+ */
+void mpmc_destroy(struct mpmc *q);
+
+/**
+ * @brief Enqueues up to `n` items, as many as there are free cells, without
+ * waiting
+ *
+ * @return The number of items enqueued, 0 if the queue is full
+ */
+size_t mpmc_try_enqueue(struct mpmc *q, const long *items, size_t n);
+
+/**
+ * @brief Dequeues up to `max` items, as many as there are, without waiting
+ *
+ * @return The number of items dequeued, 0 if the queue is empty
+ */
+size_t mpmc_try_dequeue(struct mpmc *q, long *items, size_t max);
+
+/**
+ * @brief Enqueues `n` items, waiting while the queue is full, and wakes
+ * sleeping consumers
+ */
+void mpmc_enqueue(struct mpmc *q, const long *items, size_t n);
+
+/**
+ * @brief Dequeues between 1 and `max` items, waiting while the queue is
+ * empty, and wakes sleeping producers
+ *
+ * @return The number of items dequeued
+ */
+size_t mpmc_dequeue(struct mpmc *q, long *items, size_t max);
+
+/**
+ * @brief Number of items in the queue, without synchronizing with producers
+ * and consumers (two relaxed loads): a sample for monitoring, that may count
+ * cells claimed but not yet filled or emptied
+ */
+static inline size_t mpmc_size(struct mpmc *q) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    return head - tail <= q->mask + 1 ? head - tail : 0;
+}
+
+#endif
@@ -0,0 +1,226 @@
+#define _GNU_SOURCE // sched_getaffinity, CPU_SET
+
+#include "placement.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef SYSFS_CPU
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#endif
+
+static struct topology topo;
+static int policy = PLACE_NONE;
+static int order[PLACEMENT_MAX_CPUS]; // indexes in topo.cpus, per worker
+static int nodes[PLACEMENT_MAX_CPUS]; // distinct nodes, ascending
+
+static const char *policy_names[] = {"none", "compact", "scatter", "node"};
+
+int placement_parse(const char *name) {
+    for (size_t i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]);
+         i++)
+        if (strcmp(name, policy_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+const char *placement_name(int policy) {
+    return policy >= 0 && policy <= PLACE_NODE ? policy_names[policy] : "?";
+}
+
+/**
+ * @brief Reads an integer from a file of sysfs
+ *
+ * @return The integer, or `fallback` if the file cannot be read
+ */
+static int read_int(const char *path, int fallback) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return fallback;
+    int v;
+    if (fscanf(f, "%d", &v) != 1)
+        v = fallback;
+    fclose(f);
+    return v;
+}
+
+/**
+ * @brief The NUMA node of a CPU, from the `nodeN` link in its directory
+ */
+static int node_of(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+        return 0;
+    int node = 0;
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL)
+        if (sscanf(e->d_name, "node%d", &node) == 1)
+            break;
+    closedir(dir);
+    return node;
+}
+
+static int by_place(const void *a, const void *b) {
+    const struct placement_cpu *x = a, *y = b;
+    if (x->node != y->node)
+        return x->node - y->node;
+    if (x->package != y->package)
+        return x->package - y->package;
+    if (x->core != y->core)
+        return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+static int by_cpu(const void *a, const void *b) {
+    return ((const struct placement_cpu *)a)->cpu -
+           ((const struct placement_cpu *)b)->cpu;
+}
+
+int topology_read(struct topology *t) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+        return -1;
+    memset(t, 0, sizeof(*t));
+    for (int cpu = 0; cpu < CPU_SETSIZE && t->ncpus < PLACEMENT_MAX_CPUS;
+         cpu++) {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+        char path[96];
+        struct placement_cpu *c = &t->cpus[t->ncpus++];
+        c->cpu = cpu;
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/core_id", cpu);
+        c->core = read_int(path, cpu);
+        snprintf(path, sizeof(path),
+                 SYSFS_CPU "/cpu%d/topology/physical_package_id", cpu);
+        c->package = read_int(path, 0);
+        c->node = node_of(cpu);
+    }
+
+    // SMT index and rank of the core within the node, in topological order
+    qsort(t->cpus, t->ncpus, sizeof(*t->cpus), by_place);
+    int *cores_in_node = calloc(t->ncpus, sizeof(int));
+    if (cores_in_node == NULL)
+        return -1;
+    for (int i = 0; i < t->ncpus; i++) {
+        struct placement_cpu *c = &t->cpus[i];
+        const struct placement_cpu *prev = i > 0 ? &t->cpus[i - 1] : NULL;
+        if (prev != NULL && prev->node == c->node &&
+            prev->package == c->package && prev->core == c->core) {
+            c->thread = prev->thread + 1;
+            c->rank = prev->rank;
+            continue;
+        }
+        if (prev == NULL || prev->node != c->node)
+            t->nnodes++;
+        // nodes are numbered by the kernel, count them by position
+        c->rank = cores_in_node[t->nnodes - 1]++;
+        t->ncores++;
+    }
+    free(cores_in_node);
+    qsort(t->cpus, t->ncpus, sizeof(*t->cpus), by_cpu);
+    return 0;
+}
+
+/* policies sort the indexes of `topo.cpus` */
+
+static int by_compact(const void *a, const void *b) {
+    return by_place(&topo.cpus[*(const int *)a], &topo.cpus[*(const int *)b]);
+}
+
+static int by_scatter(const void *a, const void *b) {
+    const struct placement_cpu *x = &topo.cpus[*(const int *)a],
+                               *y = &topo.cpus[*(const int *)b];
+    if (x->thread != y->thread)
+        return x->thread - y->thread;
+    if (x->rank != y->rank)
+        return x->rank - y->rank;
+    return by_place(x, y);
+}
+
+int placement_set(int p) {
+    if (p < PLACE_NONE || p > PLACE_NODE) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (topology_read(&topo) == -1)
+        return -1;
+    for (int i = 0; i < topo.ncpus; i++)
+        order[i] = i;
+    if (p == PLACE_COMPACT || p == PLACE_NODE)
+        qsort(order, topo.ncpus, sizeof(*order), by_compact);
+    else if (p == PLACE_SCATTER)
+        qsort(order, topo.ncpus, sizeof(*order), by_scatter);
+    // the nodes in compact order come by node number
+    int n = 0;
+    for (int i = 0; i < topo.ncpus && p == PLACE_NODE; i++) {
+        int node = topo.cpus[order[i]].node;
+        if (n == 0 || nodes[n - 1] != node)
+            nodes[n++] = node;
+    }
+    policy = p;
+    return 0;
+}
+
+int placement_get(void) {
+    return policy;
+}
+
+const struct topology *placement_topology(void) {
+    return topo.ncpus > 0 ? &topo : NULL;
+}
+
+int placement_apply(int index) {
+    if (policy == PLACE_NONE || topo.ncpus == 0)
+        return 0;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (policy == PLACE_NODE) {
+        int node = nodes[index % topo.nnodes];
+        for (int i = 0; i < topo.ncpus; i++)
+            if (topo.cpus[i].node == node)
+                CPU_SET(topo.cpus[i].cpu, &set);
+    } else {
+        CPU_SET(topo.cpus[order[index % topo.ncpus]].cpu, &set);
+    }
+    // 0 is the calling thread, not the whole process
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+int placement_node(int index) {
+    if (policy == PLACE_NONE || topo.ncpus == 0)
+        return -1;
+    if (policy == PLACE_NODE)
+        return nodes[index % topo.nnodes];
+    return topo.cpus[order[index % topo.ncpus]].node;
+}
+
+int placement_bind(void *addr, size_t len, int node) {
+    if (node < 0 || topo.nnodes <= 1)
+        return 0;
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t)addr + page - 1) & ~(page - 1);
+    uintptr_t last = ((uintptr_t)addr + len) & ~(page - 1);
+    if (last <= first)
+        return 0;
+    unsigned long mask[PLACEMENT_MAX_CPUS / (8 * sizeof(unsigned long))] = {0};
+    if (node >= (int)(8 * sizeof(mask))) {
+        errno = EINVAL;
+        return -1;
+    }
+    mask[node / (8 * sizeof(*mask))] |= 1ul << (node % (8 * sizeof(*mask)));
+    // no libnuma, the system call; pages touched already are migrated
+    return syscall(SYS_mbind, first, last - first, MPOL_PREFERRED, mask,
+                   8 * sizeof(mask), MPOL_MF_MOVE) == -1
+               ? -1
+               : 0;
+}
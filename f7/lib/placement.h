@@ -0,0 +1,117 @@
+/**
+ * Placement of threads and processes on the CPUs, and of their memory on the
+ * NUMA nodes, so that benchmarks run the same way every time.
+ *
+ * The topology (core, package and NUMA node of every CPU the process may run
+ * on) is read from sysfs. A policy then gives each worker index its CPUs:
+ *  - `none`:    no pinning, the scheduler decides (the default)
+ *  - `compact`: fill each core's SMT siblings, then the next core, then the
+ *               next package and node: workers share caches
+ *  - `scatter`: one worker per core, round-robin over the nodes, before any
+ *               second SMT sibling: workers get the most cache and bandwidth
+ *  - `node`:    worker `i` may run on any CPU of node `i % nodes`
+ * Indexes beyond the number of CPUs (or nodes) wrap around.
+ *
+ * Each worker pins itself with `placement_apply`, a thread right after it
+ * starts or a process right after `fork`. Memory is node-local by first
+ * touch once the worker is pinned, or with `placement_bind` (`mbind`) for
+ * memory allocated by someone else. The policy is per process, set once by
+ * the program and read by the libraries that start workers.
+ */
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stddef.h>
+
+/** CPUs of a topology, at most */
+#define PLACEMENT_MAX_CPUS 1024
+
+enum placement_policy {
+    PLACE_NONE,
+    PLACE_COMPACT,
+    PLACE_SCATTER,
+    PLACE_NODE,
+};
+
+/** A CPU and where it is */
+struct placement_cpu {
+    int cpu;
+    int core;    // core_id, unique within the package
+    int package; // physical_package_id
+    int node;    // NUMA node, 0 without NUMA
+    int thread;  // index among the SMT siblings of the core
+    int rank;    // index of the core within its node
+};
+
+struct topology {
+    int ncpus, ncores, nnodes;
+    struct placement_cpu cpus[PLACEMENT_MAX_CPUS]; // allowed ones, by number
+};
+
+/**
+ * @brief Parses the name of a policy, e.g. `"scatter"`
+ *
+ * @return The `enum placement_policy`, or -1 if the name is unknown
+ */
+int placement_parse(const char *name);
+
+/**
+ * @brief The name of a policy, e.g. for recording it with results
+ */
+const char *placement_name(int policy);
+
+/**
+ * @brief Reads the topology of the CPUs the calling thread may run on.
+ * Without sysfs, every CPU is a core of its own, on node 0
+ *
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+int topology_read(struct topology *t);
+
+/**
+ * @brief Sets the policy of the process, reading the topology
+ *
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+int placement_set(int policy);
+
+/**
+ * @brief The policy set with `placement_set`, `PLACE_NONE` by default
+ */
+int placement_get(void);
+
+/**
+ * @brief The topology read by `placement_set`, NULL before
+ */
+const struct topology *placement_topology(void);
+
+/**
+ * @brief Pins the calling thread (or process) to the CPUs of worker `index`.
+ * Does nothing with `PLACE_NONE`
+ *
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+int placement_apply(int index);
+
+/**
+ * @brief The NUMA node worker `index` runs on
+ *
+ * @return The node, -1 with `PLACE_NONE`
+ */
+int placement_node(int index);
+
+/**
+ * @brief Prefers `node` for the pages fully inside `[addr, addr + len)`,
+ * moving those already touched. Does nothing with a single node, or a
+ * negative one
+ *
+ * @retval -1 - Error, `errno` is set accordingly (e.g. `ENOSYS`, the memory
+ * is then wherever it was first touched)
+ * @retval 0 - OK
+ */
+int placement_bind(void *addr, size_t len, int node);
+
+#endif
@@ -0,0 +1,317 @@
+#include "pool.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "futex.h"
+#include "placement.h"
+
+/** A piece `[lo, hi)` of a `pool_for` */
+struct range_task {
+    struct pool_task task;
+    struct for_job *job;
+    size_t lo, hi;
+};
+
+struct for_job {
+    struct pool *pool;
+    void (*body)(void *arg, size_t lo, size_t hi, int worker);
+    void *arg;
+    size_t grain;
+    _Alignas(CACHE_LINE) atomic_size_t pending; // iterations not done yet
+    _Alignas(CACHE_LINE) atomic_size_t used;    // tasks taken from 'tasks'
+    size_t ntasks;
+    struct range_task *tasks;
+};
+
+/* ------ Chase-Lev deque (see Lê et al., PPoPP 2013, for the orderings) ------ */
+
+/**
+ * @brief Pushes a task at the bottom, by the owner only
+ *
+ * @retval -1 - The deque is full
+ * @retval 0 - OK
+ */
+static int deque_push(struct pool_deque *d, struct pool_task *t) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&d->top, memory_order_acquire);
+    if (b - top >= POOL_DEQUE_SIZE)
+        return -1;
+    atomic_store_explicit(&d->tasks[b % POOL_DEQUE_SIZE], t,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return 0;
+}
+
+/**
+ * @brief Pops the task at the bottom, by the owner only
+ *
+ * @return The task, NULL if empty
+ */
+static struct pool_task *deque_pop(struct pool_deque *d) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    if (t > b) { // empty
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    struct pool_task *task = atomic_load_explicit(
+        &d->tasks[b % POOL_DEQUE_SIZE], memory_order_relaxed);
+    if (t == b) {
+        // the last one, race with the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed))
+            task = NULL;
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+/**
+ * @brief Steals the task at the top, by any thread
+ *
+ * @return The task, NULL if empty or lost to another thief
+ */
+static struct pool_task *deque_steal(struct pool_deque *d) {
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b)
+        return NULL;
+    struct pool_task *task = atomic_load_explicit(
+        &d->tasks[t % POOL_DEQUE_SIZE], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed))
+        return NULL;
+    return task;
+}
+
+static int deque_empty(struct pool_deque *d) {
+    return atomic_load_explicit(&d->top, memory_order_relaxed) >=
+           atomic_load_explicit(&d->bottom, memory_order_relaxed);
+}
+
+/* ------ workers ------ */
+
+/**
+ * @brief Wakes a sleeping worker, if any, after a push
+ */
+static void wake_one(struct pool *p) {
+    // pairs with the fence in 'worker_main': either the sleeper sees the
+    // task, or this sees the sleeper
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&p->sleepers, memory_order_relaxed) > 0) {
+        atomic_fetch_add_explicit(&p->epoch, 1, memory_order_relaxed);
+        futex_wake(&p->epoch, 1);
+    }
+}
+
+/**
+ * @brief A task of the worker's own deque, or else one stolen from another
+ *
+ * @return The task, NULL if none was found
+ */
+static struct pool_task *find_task(struct pool_worker *w) {
+    struct pool *p = w->pool;
+    struct pool_task *t = deque_pop(&w->deque);
+    if (t != NULL || p->nworkers == 1)
+        return t;
+    // every victim once, from a random one
+    int first = rand_r(&w->seed) % p->nworkers;
+    for (int i = 0; i < p->nworkers; i++) {
+        struct pool_worker *victim = &p->workers[(first + i) % p->nworkers];
+        if (victim == w)
+            continue;
+        if ((t = deque_steal(&victim->deque)) != NULL)
+            return t;
+    }
+    return NULL;
+}
+
+static int any_task(struct pool *p) {
+    for (int i = 0; i < p->nworkers; i++)
+        if (!deque_empty(&p->workers[i].deque))
+            return 1;
+    return 0;
+}
+
+static void *worker_main(void *arg) {
+    struct pool_worker *w = arg;
+    struct pool *p = w->pool;
+    unsigned spins = 0;
+    placement_apply(w->id); // best effort, unpinned otherwise
+    while (!atomic_load_explicit(&p->stop, memory_order_acquire)) {
+        struct pool_task *t = find_task(w);
+        if (t != NULL) {
+            t->run(t, w->id);
+            spins = 0;
+            continue;
+        }
+        if (++spins < SPIN_LIMIT) {
+            cpu_relax();
+            continue;
+        }
+        // nothing to do: announce it, check once more, and sleep
+        unsigned epoch = atomic_load_explicit(&p->epoch, memory_order_relaxed);
+        atomic_fetch_add_explicit(&p->sleepers, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!any_task(p) && !atomic_load(&p->stop))
+            futex_wait(&p->epoch, epoch);
+        atomic_fetch_sub_explicit(&p->sleepers, 1, memory_order_relaxed);
+        spins = 0;
+    }
+    return NULL;
+}
+
+int pool_create(struct pool *p, int nworkers) {
+    if (nworkers <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(p, 0, sizeof(*p));
+    p->nworkers = nworkers;
+    p->workers = aligned_alloc(CACHE_LINE, nworkers * sizeof(*p->workers));
+    p->threads = calloc(nworkers, sizeof(*p->threads));
+    if (p->workers == NULL || p->threads == NULL) {
+        free(p->workers);
+        free(p->threads);
+        return -1;
+    }
+    // each deque on the node of its worker, the one that pushes and pops
+    for (int i = 0; i < nworkers; i++)
+        placement_bind(&p->workers[i], sizeof(p->workers[i]),
+                       placement_node(i));
+    memset(p->workers, 0, nworkers * sizeof(*p->workers));
+    for (int i = 0; i < nworkers; i++) {
+        p->workers[i].pool = p;
+        p->workers[i].id = i;
+        p->workers[i].seed = i + 1;
+    }
+    // worker 0 is the caller of the parallel operations
+    for (int i = 1; i < nworkers; i++) {
+        int err =
+            pthread_create(&p->threads[i], NULL, worker_main, &p->workers[i]);
+        if (err != 0) {
+            p->nworkers = i; // only those are running
+            pool_destroy(p);
+            errno = err;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void pool_destroy(struct pool *p) {
+    atomic_store(&p->stop, 1);
+    atomic_fetch_add(&p->epoch, 1);
+    futex_wake_all(&p->epoch);
+    for (int i = 1; i < p->nworkers; i++)
+        pthread_join(p->threads[i], NULL);
+    free(p->workers);
+    free(p->threads);
+    p->workers = NULL;
+    p->threads = NULL;
+}
+
+/**
+ * @brief Runs a piece of a `pool_for`: pushes halves of it while it is larger
+ * than the grain, then calls the body on what is left
+ */
+static void run_range(struct pool_task *self, int worker) {
+    struct range_task *r = (struct range_task *)self;
+    struct for_job *job = r->job;
+    struct pool_deque *d = &job->pool->workers[worker].deque;
+    size_t lo = r->lo, hi = r->hi;
+    while (hi - lo > job->grain) {
+        size_t i =
+            atomic_fetch_add_explicit(&job->used, 1, memory_order_relaxed);
+        if (i >= job->ntasks)
+            break; // out of tasks, do the rest here
+        size_t mid = lo + (hi - lo) / 2;
+        struct range_task *half = &job->tasks[i];
+        *half = (struct range_task){{run_range}, job, mid, hi};
+        if (deque_push(d, &half->task) == -1)
+            break;
+        wake_one(job->pool);
+        hi = mid;
+    }
+    job->body(job->arg, lo, hi, worker);
+    atomic_fetch_sub_explicit(&job->pending, hi - lo, memory_order_release);
+}
+
+int pool_for(struct pool *p, size_t n, size_t grain,
+             void (*body)(void *arg, size_t lo, size_t hi, int worker),
+             void *arg) {
+    if (n == 0)
+        return 0;
+    if (grain == 0)
+        grain = 1;
+    // every split makes a task, and pieces are at least 'grain / 2' long
+    struct for_job job = {.pool = p, .body = body, .arg = arg, .grain = grain};
+    job.ntasks = 2 * (n / grain) + 1;
+    job.tasks = malloc(job.ntasks * sizeof(*job.tasks));
+    if (job.tasks == NULL)
+        return -1;
+    atomic_init(&job.pending, n);
+    atomic_init(&job.used, 1);
+
+    // the caller is worker 0: it starts with the whole range
+    struct pool_worker *self = &p->workers[0];
+    job.tasks[0] = (struct range_task){{run_range}, &job, 0, n};
+    run_range(&job.tasks[0].task, 0);
+    unsigned spins = 0;
+    while (atomic_load_explicit(&job.pending, memory_order_acquire) > 0) {
+        struct pool_task *t = find_task(self);
+        if (t != NULL)
+            t->run(t, 0);
+        else
+            spin_wait(&spins); // the last pieces are being run by others
+    }
+    free(job.tasks);
+    return 0;
+}
+
+/** State of a `pool_reduce`, passed to its `pool_for` */
+struct reduce_job {
+    void (*body)(void *arg, size_t lo, size_t hi, void *acc);
+    void *arg;
+    char *accs; // one per worker, each 'stride' bytes
+    size_t stride;
+};
+
+static void reduce_body(void *arg, size_t lo, size_t hi, int worker) {
+    struct reduce_job *job = arg;
+    job->body(job->arg, lo, hi, job->accs + worker * job->stride);
+}
+
+int pool_reduce(struct pool *p, size_t n, size_t grain, size_t acc_size,
+                void (*init)(void *arg, void *acc),
+                void (*body)(void *arg, size_t lo, size_t hi, void *acc),
+                void (*merge)(void *arg, void *dst, const void *src),
+                void *arg, void *result) {
+    // accumulators in separate cache lines, written without false sharing
+    size_t stride = (acc_size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    struct reduce_job job = {body, arg, aligned_alloc(CACHE_LINE,
+                                                      p->nworkers * stride),
+                             stride};
+    if (job.accs == NULL)
+        return -1;
+    for (int i = 0; i < p->nworkers; i++)
+        init(arg, job.accs + i * stride);
+    int ret = pool_for(p, n, grain, reduce_body, &job);
+    if (ret == 0) {
+        init(arg, result);
+        for (int i = 0; i < p->nworkers; i++)
+            merge(arg, result, job.accs + i * stride);
+    }
+    free(job.accs);
+    return ret;
+}
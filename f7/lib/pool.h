@@ -0,0 +1,106 @@
+/**
+ * Work-stealing thread pool, with parallel-for and parallel-reduce helpers.
+ *
+ * Each worker has a Chase-Lev deque of tasks: the worker pushes and pops at
+ * the bottom (LIFO, the task it just split is still in cache), and idle
+ * workers steal from the top of a random victim (FIFO, the largest pieces of
+ * work). A range is split in halves while it is larger than the grain: one
+ * half is pushed, the other processed, so busy workers keep making work
+ * available and uneven ranges are balanced by whoever is idle.
+ *
+ * Idle workers spin for a while and then sleep on a futex; pushing a task
+ * only makes the `futex_wake` system call when some worker is asleep.
+ *
+ * The thread calling `pool_for` or `pool_reduce` takes part as worker 0, so a
+ * pool of `n` workers has `n - 1` threads. One parallel operation at a time,
+ * and not from inside another one.
+ *
+ * The threads follow the policy of `placement.h`: worker `i` pins itself with
+ * `placement_apply(i)`, and its deque is bound to its node. The caller is
+ * left where it is, it may pin itself as worker 0.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "spin.h"
+
+/** Tasks a deque holds, beyond that a worker does the work itself */
+#define POOL_DEQUE_SIZE 4096
+
+struct pool_task {
+    void (*run)(struct pool_task *self, int worker);
+};
+
+/** Chase-Lev deque, of fixed size */
+struct pool_deque {
+    _Alignas(CACHE_LINE) atomic_long top;    // next to steal
+    _Alignas(CACHE_LINE) atomic_long bottom; // next to push
+    _Atomic(struct pool_task *) tasks[POOL_DEQUE_SIZE];
+};
+
+struct pool_worker {
+    struct pool_deque deque;
+    struct pool *pool;
+    int id;
+    unsigned seed; // for picking victims
+};
+
+struct pool {
+    int nworkers;
+    struct pool_worker *workers;
+    pthread_t *threads;
+    _Alignas(CACHE_LINE) atomic_uint epoch; // futex, bumped to wake
+    atomic_int sleepers;
+    atomic_int stop;
+};
+
+/**
+ * @brief Starts a pool of `nworkers` workers, the caller and `nworkers - 1`
+ * threads
+ *
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+int pool_create(struct pool *p, int nworkers);
+
+/**
+ * @brief Stops the threads of a pool and frees it
+ */
+void pool_destroy(struct pool *p);
+
+/**
+ * @brief Calls `body(arg, lo, hi, worker)` on pieces `[lo, hi)` of `[0, n)`,
+ * in parallel, and returns when all of them are done
+ *
+ * @param grain Pieces are not split below this size
+ * @param body Called with the index of the worker, in `[0, nworkers)`
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+int pool_for(struct pool *p, size_t n, size_t grain,
+             void (*body)(void *arg, size_t lo, size_t hi, int worker),
+             void *arg);
+
+/**
+ * @brief Parallel reduction over `[0, n)`: each worker accumulates its
+ * pieces into its own accumulator, and the accumulators are merged at the end
+ *
+ * @param acc_size The size of an accumulator
+ * @param init Sets an accumulator to the identity
+ * @param body Accumulates `[lo, hi)` into `acc`
+ * @param merge Accumulates `src` into `dst`
+ * @param result Output, the merged accumulator
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+int pool_reduce(struct pool *p, size_t n, size_t grain, size_t acc_size,
+                void (*init)(void *arg, void *acc),
+                void (*body)(void *arg, size_t lo, size_t hi, void *acc),
+                void (*merge)(void *arg, void *dst, const void *src),
+                void *arg, void *result);
+
+#endif
@@ -0,0 +1,107 @@
+#include "progress.h"
+
+#include <errno.h>
+#include <time.h>
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void progress_init(struct progress *p, int interval_ms, FILE *out) {
+    p->out = out;
+    p->interval_ms = interval_ms > 0 ? interval_ms : 1;
+    p->nvalues = p->ngroups = 0;
+    p->stop = 0;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+}
+
+int progress_add(struct progress *p, const char *const *names, int n,
+                 int kind, progress_fn read, void *arg) {
+    if (n <= 0 || p->nvalues + n > PROGRESS_MAX_VALUES)
+        return -1;
+    p->groups[p->ngroups++] = (struct progress_group){read, arg, p->nvalues, n};
+    for (int i = 0; i < n; i++) {
+        p->names[p->nvalues] = names[i];
+        p->kinds[p->nvalues] = kind;
+        p->last[p->nvalues++] = 0;
+    }
+    return 0;
+}
+
+static void read_word(void *arg, long *values) {
+    values[0] = atomic_load_explicit((const atomic_long *)arg,
+                                     memory_order_relaxed);
+}
+
+int progress_add_word(struct progress *p, const char *name, int kind,
+                      const atomic_long *word) {
+    return progress_add(p, &name, 1, kind, read_word, (void *)word);
+}
+
+/**
+ * @brief Reads every value and prints a line of the timeline
+ */
+static void sample(struct progress *p) {
+    long values[PROGRESS_MAX_VALUES];
+    for (int g = 0; g < p->ngroups; g++)
+        p->groups[g].read(p->groups[g].arg, &values[p->groups[g].first]);
+    double t = now();
+    double dt = t - p->last_time;
+    fprintf(p->out, "progress %8.3fs", t - p->start);
+    for (int i = 0; i < p->nvalues; i++) {
+        fprintf(p->out, "  %s %ld", p->names[i], values[i]);
+        if (p->kinds[i] == PROGRESS_COUNT) {
+            double rate = dt > 0 ? (values[i] - p->last[i]) / dt : 0;
+            fprintf(p->out, " (%.2fM/s)", rate / 1e6);
+        }
+        p->last[i] = values[i];
+    }
+    fprintf(p->out, "\n");
+    fflush(p->out);
+    p->last_time = t;
+}
+
+static void *reporter(void *arg) {
+    struct progress *p = arg;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop) {
+        // absolute deadlines, so that the samples do not drift
+        deadline.tv_nsec += p->interval_ms % 1000 * 1000000l;
+        deadline.tv_sec += p->interval_ms / 1000 + deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        while (!p->stop &&
+               pthread_cond_timedwait(&p->wake, &p->lock, &deadline) !=
+                   ETIMEDOUT)
+            ;
+        if (!p->stop)
+            sample(p);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+int progress_start(struct progress *p) {
+    p->start = p->last_time = now();
+    int err = pthread_create(&p->tid, NULL, reporter, p);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+void progress_stop(struct progress *p) {
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->tid, NULL);
+    sample(p);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+}
@@ -0,0 +1,101 @@
+/**
+ * Progress reporter: a thread that samples counters every few milliseconds
+ * and prints a timeline of their values and rates, while the program runs.
+ *
+ * It never takes a lock the workers take. Single words are read with atomic
+ * loads; values that must be consistent with each other (a thread's
+ * operations and what they found) are read together by a callback, typically
+ * through a seqlock (`lib/seqlock.h`). So monitoring costs the workers
+ * nothing but the cache misses on the lines the reporter reads, a few times a
+ * second.
+ *
+ * Each value is either a count, that only grows and whose rate per second is
+ * printed, or a gauge (a level, like the depth of a queue), printed as is.
+ * The timeline goes to a stream, one line per sample:
+ *
+ *     progress    0.200s  inc 1523044 (7.62M/s)  dec 1498221 (7.49M/s)  count 24823
+ */
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+/** Values sampled by a reporter */
+#define PROGRESS_MAX_VALUES 16
+
+enum progress_kind {
+    PROGRESS_COUNT, // print the rate
+    PROGRESS_GAUGE, // print the level
+};
+
+/**
+ * Reads `n` values at once, `n` being the number of names it was added with
+ */
+typedef void (*progress_fn)(void *arg, long *values);
+
+struct progress_group {
+    progress_fn read;
+    void *arg;
+    int first, n; // indexes of its values
+};
+
+struct progress {
+    FILE *out;
+    int interval_ms;
+    int nvalues, ngroups;
+    const char *names[PROGRESS_MAX_VALUES];
+    int kinds[PROGRESS_MAX_VALUES];
+    long last[PROGRESS_MAX_VALUES]; // previous sample, for the rates
+    double last_time, start;
+    struct progress_group groups[PROGRESS_MAX_VALUES];
+    pthread_t tid;
+    int stop; // protected by `lock`, taken only by the reporter and the owner
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+};
+
+/**
+ * @brief Initializes a reporter, without any value
+ *
+ * @param p The reporter
+ * @param interval_ms Time between samples
+ * @param out Stream of the timeline, e.g. `stderr`
+ */
+void progress_init(struct progress *p, int interval_ms, FILE *out);
+
+/**
+ * @brief Adds a word, read with an atomic load
+ *
+ * @retval -1 - Too many values
+ * @retval 0 - OK
+ */
+int progress_add_word(struct progress *p, const char *name, int kind,
+                      const atomic_long *word);
+
+/**
+ * @brief Adds `n` values, read at once by `read(arg, values)`
+ *
+ * @param names Their names, the strings must outlive the reporter
+ * @param kind `PROGRESS_COUNT` or `PROGRESS_GAUGE`, for all of them
+ * @retval -1 - Too many values
+ * @retval 0 - OK
+ */
+int progress_add(struct progress *p, const char *const *names, int n,
+                 int kind, progress_fn read, void *arg);
+
+/**
+ * @brief Starts sampling, in a thread of its own
+ *
+ * @retval -1 - Error, `errno` is set accordingly
+ * @retval 0 - OK
+ */
+int progress_start(struct progress *p);
+
+/**
+ * @brief Stops sampling, prints a last sample, and joins the thread
+ */
+void progress_stop(struct progress *p);
+
+#endif
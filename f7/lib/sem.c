@@ -0,0 +1,66 @@
+#include "sem.h"
+
+#include <sched.h>
+
+#include "futex.h"
+#include "lock.h"
+
+void fsem_init(struct fsem *s, unsigned value) {
+    *s = (struct fsem)FSEM_INITIALIZER(value);
+}
+
+void fsem_post(struct fsem *s, unsigned n) {
+    atomic_fetch_add_explicit(&s->value, n, memory_order_release);
+    // pairs with the fence in 'fsem_wait_many': either the waiter sees the
+    // units, or this sees the waiter
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&s->sleepers, memory_order_relaxed) > 0) {
+        atomic_fetch_add_explicit(&s->wakes, 1, memory_order_relaxed);
+        // the ones woken no longer count, even before they get to run
+        int woken = futex_wake(&s->value, n);
+        if (woken > 0)
+            atomic_fetch_sub_explicit(&s->sleepers, woken,
+                                      memory_order_relaxed);
+    }
+}
+
+unsigned fsem_try_wait_many(struct fsem *s, unsigned max) {
+    unsigned v = atomic_load_explicit(&s->value, memory_order_relaxed);
+    while (v > 0) {
+        unsigned take = v < max ? v : max;
+        // on failure, 'v' is reloaded with the current value
+        if (atomic_compare_exchange_weak_explicit(&s->value, &v, v - take,
+                                                  memory_order_acquire,
+                                                  memory_order_relaxed))
+            return take;
+    }
+    return 0;
+}
+
+unsigned fsem_wait_many(struct fsem *s, unsigned max) {
+    unsigned budget = lock_spin_budget(SPIN_LIMIT);
+    for (unsigned spins = 0;; spins++) {
+        unsigned taken = fsem_try_wait_many(s, max);
+        if (taken > 0)
+            return taken;
+        if (spins < budget) {
+            cpu_relax();
+            continue;
+        }
+        if (spins == budget) {
+            // let the posters run, on this CPU if there is only one
+            sched_yield();
+            continue;
+        }
+        atomic_fetch_add_explicit(&s->sleepers, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&s->value, memory_order_relaxed) == 0) {
+            atomic_fetch_add_explicit(&s->sleeps, 1, memory_order_relaxed);
+            // fails at once if posted meanwhile. If woken, the poster
+            // already removed it from the sleepers
+            if (futex_wait(&s->value, 0) == 0)
+                continue;
+        }
+        atomic_fetch_sub_explicit(&s->sleepers, 1, memory_order_relaxed);
+    }
+}
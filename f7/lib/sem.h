@@ -0,0 +1,60 @@
+/**
+ * Counting semaphore on a futex word, with bulk operations.
+ *
+ * The value is the futex word itself. `fsem_post` adds `n` units with a
+ * single atomic add, and `fsem_wait_many` takes every unit available, up to
+ * `max`, with a single compare-and-swap. A waiter only sleeps when the value
+ * is 0, and a poster only makes the `futex_wake` system call when some waiter
+ * is registered as sleeping, so system calls happen only for actual sleeps
+ * and wake-ups. Before sleeping, a waiter spins for a while (not with a single
+ * CPU online, see `lock_spin_budget`) and then yields the CPU once.
+ *
+ * Unlike a condition variable signalled only when a count goes from 0 to 1,
+ * every post wakes up to `n` sleepers, so no consumer is left asleep while
+ * units are available.
+ */
+#ifndef SEM_H
+#define SEM_H
+
+#include <stdatomic.h>
+
+struct fsem {
+    atomic_uint value;    // futex, units available
+    atomic_uint sleepers; // waiters asleep or about to, and not yet woken
+    atomic_ulong sleeps;  // statistics: calls to futex_wait
+    atomic_ulong wakes;   // statistics: calls to futex_wake
+};
+
+#define FSEM_INITIALIZER(v) {(v), 0, 0, 0}
+
+void fsem_init(struct fsem *s, unsigned value);
+
+/**
+ * @brief Adds `n` units, and wakes up to `n` sleeping waiters
+ */
+void fsem_post(struct fsem *s, unsigned n);
+
+/**
+ * @brief Takes between 1 and `max` units, as many as available, without
+ * waiting
+ *
+ * @return The number of units taken, 0 if none is available
+ */
+unsigned fsem_try_wait_many(struct fsem *s, unsigned max);
+
+/**
+ * @brief Takes between 1 and `max` units, as many as available, waiting
+ * while there are none
+ *
+ * @return The number of units taken
+ */
+unsigned fsem_wait_many(struct fsem *s, unsigned max);
+
+/**
+ * @brief Takes one unit, waiting while there are none
+ */
+static inline void fsem_wait(struct fsem *s) {
+    fsem_wait_many(s, 1);
+}
+
+#endif
@@ -0,0 +1,79 @@
+/**
+ * Sequence lock, for snapshots of several words that a single writer updates
+ * often and readers sample rarely, without readers ever blocking the writer.
+ *
+ * The writer makes the sequence odd, updates the words, and makes it even
+ * again. A reader reads the sequence, the words, and the sequence again, and
+ * retries if it was odd or changed meanwhile. The writer never waits and
+ * never writes a shared line other than its own, readers only read.
+ *
+ * The protected words must be atomics accessed with relaxed loads and
+ * stores (`seqlock_load`, `seqlock_store`), since readers race with the
+ * writer by design. On x86, these are plain moves and both fences only
+ * constrain the compiler. Several writers must be serialized by other means.
+ */
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdatomic.h>
+
+#include "spin.h"
+
+struct seqlock {
+    atomic_uint seq; // odd while a write is in progress
+};
+
+#define SEQLOCK_INITIALIZER {0}
+
+#define seqlock_load(word) atomic_load_explicit(word, memory_order_relaxed)
+#define seqlock_store(word, v)                                                 \
+    atomic_store_explicit(word, v, memory_order_relaxed)
+
+static inline void seqlock_init(struct seqlock *s) {
+    atomic_init(&s->seq, 0);
+}
+
+/**
+ * @brief Starts a write, the words may then be stored
+ */
+static inline void seqlock_write_begin(struct seqlock *s) {
+    unsigned seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    // the odd sequence is visible before any of the new words
+    atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * @brief Ends a write, publishing the words stored since the beginning
+ */
+static inline void seqlock_write_end(struct seqlock *s) {
+    unsigned seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_release);
+}
+
+/**
+ * @brief Starts a read, waiting for a write in progress to end
+ *
+ * @return The sequence, to give to `seqlock_read_retry`
+ */
+static inline unsigned seqlock_read_begin(const struct seqlock *s) {
+    unsigned seq, spins = 0;
+    // the writer may have been preempted mid-write, spin_wait yields
+    while ((seq = atomic_load_explicit(&s->seq, memory_order_acquire)) & 1)
+        spin_wait(&spins);
+    return seq;
+}
+
+/**
+ * @brief Ends a read
+ *
+ * @param seq The sequence returned by `seqlock_read_begin`
+ * @return Whether a write overlapped the read, which must then be retried
+ */
+static inline int seqlock_read_retry(const struct seqlock *s, unsigned seq) {
+    // the words are loaded before the sequence is checked again
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&s->seq, memory_order_relaxed) != seq;
+}
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * Busy-waiting locks: a test-and-test-and-set spinlock and a FIFO ticket
+ * lock, plus the helpers shared by every lock that spins.
+ *
+ * Waiters spin on a plain load, so the cache line stays shared while the lock
+ * is held and is only written when it looks free. After `SPIN_LIMIT`
+ * iterations they yield the CPU, so that an owner that was preempted can run
+ * (otherwise, with more threads than cores, a waiter burns its whole time
+ * slice for nothing).
+ */
+#ifndef SPIN_H
+#define SPIN_H
+
+#include <sched.h>
+#include <stdatomic.h>
+
+#define CACHE_LINE 64
+/** Iterations of busy-waiting before yielding the CPU */
+#define SPIN_LIMIT 1024
+
+/**
+ * @brief Hints the CPU that this is a busy-wait loop
+ */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+/**
+ * @brief One iteration of a busy-wait loop
+ *
+ * @param spins Iterations so far, starting at 0
+ */
+static inline void spin_wait(unsigned *spins) {
+    if (++*spins % SPIN_LIMIT == 0)
+        sched_yield();
+    else
+        cpu_relax();
+}
+
+/** Test-and-test-and-set spinlock */
+struct spinlock {
+    atomic_int locked;
+};
+
+#define SPINLOCK_INITIALIZER {0}
+
+static inline void spin_lock(struct spinlock *l) {
+    unsigned spins = 0;
+    for (;;) {
+        if (!atomic_exchange_explicit(&l->locked, 1, memory_order_acquire))
+            return;
+        while (atomic_load_explicit(&l->locked, memory_order_relaxed))
+            spin_wait(&spins);
+    }
+}
+
+static inline void spin_unlock(struct spinlock *l) {
+    atomic_store_explicit(&l->locked, 0, memory_order_release);
+}
+
+/** Ticket lock, waiters get the lock in arrival order */
+struct ticket_lock {
+    atomic_uint next;    // next ticket to be handed out
+    atomic_uint serving; // ticket holding the lock
+};
+
+#define TICKET_LOCK_INITIALIZER {0, 0}
+
+static inline void ticket_lock(struct ticket_lock *l) {
+    unsigned ticket =
+        atomic_fetch_add_explicit(&l->next, 1, memory_order_relaxed);
+    unsigned spins = 0;
+    while (atomic_load_explicit(&l->serving, memory_order_acquire) != ticket)
+        spin_wait(&spins);
+}
+
+static inline void ticket_unlock(struct ticket_lock *l) {
+    // only the owner writes 'serving', no read-modify-write needed
+    unsigned serving =
+        atomic_load_explicit(&l->serving, memory_order_relaxed);
+    atomic_store_explicit(&l->serving, serving + 1, memory_order_release);
+}
+
+#endif
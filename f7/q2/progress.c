@@ -0,0 +1,120 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../lib/progress.h"
+#include "../lib/seqlock.h"
+
+/*
+ * Same as inc_dec.c, with live progress. In inc_dec.c, the consumer prints
+ * while holding the lock whenever the count goes negative, and a monitor
+ * would have to take the same lock to read the count. Here:
+ *  - the count is an atomic word, still updated under the lock (a relaxed
+ *    load and store, no atomic read-modify-write), so that the reporter reads
+ *    it with a single atomic load
+ *  - each thread publishes its operations and the negative counts it saw,
+ *    together, through a seqlock that only it writes, instead of printing
+ *  - a reporter thread (lib/progress.h) prints their sum and rates
+ * The workers never wait for the reporter.
+ *
+ * Options: -n iterations per thread (default 1000000), -r milliseconds
+ * between samples (default 100).
+ */
+struct stats {
+    _Alignas(CACHE_LINE) struct seqlock seq;
+    atomic_long ops;
+    atomic_long negatives; // decrements that left the count negative
+};
+
+atomic_long count = 0;
+pthread_mutex_t lock;
+struct stats inc_stats, dec_stats;
+long iterations = 1000000;
+
+void *inc(void *arg) {
+    (void)arg;
+    for (long i = 0; i < iterations; i++) {
+        pthread_mutex_lock(&lock);
+        seqlock_store(&count, seqlock_load(&count) + 1);
+        pthread_mutex_unlock(&lock);
+        seqlock_write_begin(&inc_stats.seq);
+        seqlock_store(&inc_stats.ops, i + 1);
+        seqlock_write_end(&inc_stats.seq);
+    }
+    return NULL;
+}
+
+void *dec(void *arg) {
+    (void)arg;
+    long negatives = 0;
+    for (long i = 0; i < iterations; i++) {
+        pthread_mutex_lock(&lock);
+        long c = seqlock_load(&count) - 1;
+        seqlock_store(&count, c);
+        pthread_mutex_unlock(&lock);
+        negatives += c < 0;
+        seqlock_write_begin(&dec_stats.seq);
+        seqlock_store(&dec_stats.ops, i + 1);
+        seqlock_store(&dec_stats.negatives, negatives);
+        seqlock_write_end(&dec_stats.seq);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Reads the operations and negative counts of both threads, each
+ * thread's pair being consistent
+ */
+void read_stats(void *arg, long *values) {
+    (void)arg;
+    struct stats *all[] = {&inc_stats, &dec_stats};
+    values[2] = 0;
+    for (int i = 0; i < 2; i++) {
+        unsigned seq;
+        long negatives;
+        do {
+            seq = seqlock_read_begin(&all[i]->seq);
+            values[i] = seqlock_load(&all[i]->ops);
+            negatives = seqlock_load(&all[i]->negatives);
+        } while (seqlock_read_retry(&all[i]->seq, seq));
+        values[2] += negatives;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int interval_ms = 100, opt;
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = atol(optarg);
+                break;
+            case 'r':
+                interval_ms = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] [-r ms]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    struct progress p;
+    progress_init(&p, interval_ms, stderr);
+    const char *const names[] = {"inc", "dec", "negative"};
+    progress_add(&p, names, 3, PROGRESS_COUNT, read_stats, NULL);
+    progress_add_word(&p, "count", PROGRESS_GAUGE, &count);
+
+    printf("Start: %ld\n", atomic_load(&count));
+    pthread_mutex_init(&lock, NULL);
+    progress_start(&p);
+    pthread_t tid1, tid2;
+    pthread_create(&tid1, NULL, inc, NULL);
+    pthread_create(&tid2, NULL, dec, NULL);
+    pthread_join(tid1, NULL);
+    pthread_join(tid2, NULL);
+    progress_stop(&p);
+    pthread_mutex_destroy(&lock);
+    printf("End: %ld (%ld decrements went negative)\n", atomic_load(&count),
+           atomic_load(&dec_stats.negatives));
+}
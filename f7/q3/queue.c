@@ -0,0 +1,301 @@
+/**
+ * The inc/dec problem of `enhanced.c` with `-p` producers and `-c` consumers,
+ * handing off items either through the count protected by a mutex and a
+ * condition variable of `enhanced.c` (`-m condvar`), or through the lock-free
+ * queue of `lib/mpmc.h` (`-m queue`), `-b` items at a time. With `-m both`
+ * (the default), both run one after the other.
+ *
+ * Each producer makes `-n` items, numbered from 1. The consumers split them
+ * between themselves and add them up, so the result is checked against the
+ * expected sum (for the condvar version, the count must end at 0).
+ *
+ * With `-r ms`, a reporter thread (lib/progress.h) prints the items made and
+ * taken so far, their rates, and the depth of the queue (or the count), every
+ * `ms` milliseconds. The workers publish their progress with relaxed atomic
+ * stores to words only they write, so the reporter never takes their lock.
+ *
+ * With `-a policy`, worker `i` (producers first, then consumers) pins itself
+ * with the policy of `lib/placement.h`. The policy and the topology are
+ * printed before the results.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../lib/mpmc.h"
+#include "../lib/placement.h"
+#include "../lib/progress.h"
+
+#define MAX_THREADS 256
+#define MAX_BATCH 256
+
+struct worker {
+    pthread_t tid;
+    int id;              // index, for the placement
+    void *(*fn)(void *); // inc or dec
+    long items; // to make or to take
+    long sum;         // of the items taken
+    atomic_long done; // items made or taken so far, for the reporter
+};
+
+static int batch = 16;
+static int report_ms = 0;
+
+/**
+ * @brief Publishes `k` more items done by `w`, which only `w` writes
+ */
+static inline void advance(struct worker *w, long k) {
+    atomic_store_explicit(&w->done,
+                          atomic_load_explicit(&w->done, memory_order_relaxed) +
+                              k,
+                          memory_order_relaxed);
+}
+
+/* ------ mutex and condition variable, as in enhanced.c ------ */
+static atomic_long count = 0; // relaxed, under the lock
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t not_zero = PTHREAD_COND_INITIALIZER;
+
+void *inc_condvar(void *arg) {
+    struct worker *w = arg;
+    for (long i = 0; i < w->items; i++) {
+        pthread_mutex_lock(&lock);
+        long c = atomic_load_explicit(&count, memory_order_relaxed) + 1;
+        atomic_store_explicit(&count, c, memory_order_relaxed);
+        if (c == 1)
+            pthread_cond_broadcast(&not_zero); // several consumers may wait
+        pthread_mutex_unlock(&lock);
+        advance(w, 1);
+    }
+    return NULL;
+}
+
+void *dec_condvar(void *arg) {
+    struct worker *w = arg;
+    for (long i = 0; i < w->items; i++) {
+        pthread_mutex_lock(&lock);
+        while (atomic_load_explicit(&count, memory_order_relaxed) == 0)
+            pthread_cond_wait(&not_zero, &lock);
+        atomic_store_explicit(
+            &count, atomic_load_explicit(&count, memory_order_relaxed) - 1,
+            memory_order_relaxed);
+        pthread_mutex_unlock(&lock);
+        advance(w, 1);
+    }
+    return NULL;
+}
+
+/* ------ lock-free queue ------ */
+static struct mpmc queue;
+
+void *inc_queue(void *arg) {
+    struct worker *w = arg;
+    long items[MAX_BATCH];
+    for (long i = 0; i < w->items; i += batch) {
+        int k = w->items - i < batch ? w->items - i : batch;
+        for (int j = 0; j < k; j++)
+            items[j] = i + j + 1;
+        mpmc_enqueue(&queue, items, k);
+        advance(w, k);
+    }
+    return NULL;
+}
+
+void *dec_queue(void *arg) {
+    struct worker *w = arg;
+    long items[MAX_BATCH];
+    for (long left = w->items; left > 0;) {
+        size_t k = mpmc_dequeue(&queue, items, left < batch ? left : batch);
+        for (size_t j = 0; j < k; j++)
+            w->sum += items[j];
+        left -= k;
+        advance(w, k);
+    }
+    return NULL;
+}
+
+/* ------ progress ------ */
+static struct worker workers[2 * MAX_THREADS];
+static int nproducers, nconsumers;
+
+/**
+ * @brief Reads the items made and taken so far
+ */
+void read_progress(void *arg, long *values) {
+    (void)arg;
+    values[0] = values[1] = 0;
+    for (int i = 0; i < nproducers + nconsumers; i++)
+        values[i >= nproducers] +=
+            atomic_load_explicit(&workers[i].done, memory_order_relaxed);
+}
+
+/**
+ * @brief Reads the items in between, in the queue `arg`, or the count if NULL
+ */
+void read_depth(void *arg, long *values) {
+    values[0] = arg == NULL ? atomic_load_explicit(&count, memory_order_relaxed)
+                            : (long)mpmc_size(arg);
+}
+
+/**
+ * @brief Start routine of the workers: pins the thread, then runs its part
+ */
+void *start_worker(void *arg) {
+    struct worker *w = arg;
+    if (placement_apply(w->id) == -1)
+        perror("placement_apply");
+    return w->fn(w);
+}
+
+/**
+ * @brief Current time of the monotonic clock, in seconds
+ */
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Runs `producers` threads of `inc` and `consumers` threads of `dec`,
+ * and prints the throughput. Exits on failure
+ *
+ * @return Whether the result is correct
+ */
+int run(const char *name, void *(*inc)(void *), void *(*dec)(void *),
+        int producers, int consumers, long n) {
+    memset(workers, 0, sizeof(workers));
+    nproducers = producers;
+    nconsumers = consumers;
+    struct progress p;
+    if (report_ms > 0) {
+        const char *const names[] = {"made", "taken"};
+        const char *const depth[] = {inc == inc_condvar ? "count" : "depth"};
+        void *arg = inc == inc_condvar ? NULL : &queue;
+        progress_init(&p, report_ms, stderr);
+        progress_add(&p, names, 2, PROGRESS_COUNT, read_progress, NULL);
+        progress_add(&p, depth, 1, PROGRESS_GAUGE, read_depth, arg);
+        progress_start(&p);
+    }
+    long total = producers * n;
+    double start = now();
+    for (int i = 0; i < producers + consumers; i++) {
+        struct worker *w = &workers[i];
+        if (i < producers) {
+            w->items = n;
+        } else {
+            // split evenly, the first ones take the remainder
+            int c = i - producers;
+            w->items = total / consumers + (c < total % consumers);
+        }
+        w->id = i;
+        w->fn = i < producers ? inc : dec;
+        if (pthread_create(&w->tid, NULL, start_worker, w) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    long sum = 0;
+    for (int i = 0; i < producers + consumers; i++) {
+        pthread_join(workers[i].tid, NULL);
+        sum += workers[i].sum;
+    }
+    double elapsed = now() - start;
+    if (report_ms > 0)
+        progress_stop(&p);
+
+    int ok = inc == inc_condvar ? count == 0
+                                : sum == producers * (n * (n + 1) / 2);
+    printf("%-8s %9d %9d %6d %10.3f %14.0f %8s\n", name, producers, consumers,
+           inc == inc_condvar ? 1 : batch, elapsed, total / elapsed,
+           ok ? "yes" : "NO");
+    return ok;
+}
+
+void usage(char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-p producers] [-c consumers] [-n items] [-b batch] "
+            "[-q capacity] [-m condvar|queue|both] [-r ms] [-a policy]\n"
+            "  -p, -c  threads of each kind, up to %d (default 1)\n"
+            "  -n      items made by each producer (default 1000000)\n"
+            "  -b      items per enqueue and dequeue, up to %d (default 16)\n"
+            "  -q      capacity of the queue (default 1024)\n"
+            "  -r      print the progress every ms milliseconds (default: "
+            "never)\n"
+            "  -a      pin the threads: none (default), compact, scatter or "
+            "node\n",
+            prog, MAX_THREADS, MAX_BATCH);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    int producers = 1, consumers = 1;
+    long n = 1000000, capacity = 1024;
+    const char *mode = "both";
+    int policy = PLACE_NONE, opt;
+    while ((opt = getopt(argc, argv, "p:c:n:b:q:m:r:a:")) != -1) {
+        switch (opt) {
+            case 'p':
+                producers = atoi(optarg);
+                break;
+            case 'c':
+                consumers = atoi(optarg);
+                break;
+            case 'n':
+                n = atol(optarg);
+                break;
+            case 'b':
+                batch = atoi(optarg);
+                break;
+            case 'q':
+                capacity = atol(optarg);
+                break;
+            case 'm':
+                mode = optarg;
+                break;
+            case 'r':
+                report_ms = atoi(optarg);
+                break;
+            case 'a':
+                if ((policy = placement_parse(optarg)) == -1)
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    int condvar = strcmp(mode, "condvar") == 0 || strcmp(mode, "both") == 0;
+    int lockfree = strcmp(mode, "queue") == 0 || strcmp(mode, "both") == 0;
+    if (producers <= 0 || producers > MAX_THREADS || consumers <= 0 ||
+        consumers > MAX_THREADS || n <= 0 || batch <= 0 || batch > MAX_BATCH ||
+        capacity <= 0 || (!condvar && !lockfree))
+        usage(argv[0]);
+
+    // the topology is read even without pinning, to record it
+    if (placement_set(policy) == -1) {
+        fprintf(stderr, "Failed to read the topology. Cause: %s\n",
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+    const struct topology *topo = placement_topology();
+    printf("placement %s: %d cpus, %d cores, %d nodes\n",
+           placement_name(policy), topo->ncpus, topo->ncores, topo->nnodes);
+    printf("%-8s %9s %9s %6s %10s %14s %8s\n", "mode", "producers",
+           "consumers", "batch", "elapsed_s", "items/s", "correct");
+    int ok = 1;
+    if (condvar)
+        ok &= run("condvar", inc_condvar, dec_condvar, producers, consumers, n);
+    if (lockfree) {
+        if (mpmc_init(&queue, capacity) == -1) {
+            perror("mpmc_init");
+            return EXIT_FAILURE;
+        }
+        ok &= run("queue", inc_queue, dec_queue, producers, consumers, n);
+        mpmc_destroy(&queue);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,247 @@
+/**
+ * The inc/dec problem of `enhanced.c` with `-p` producers and `-c` consumers,
+ * the count being either protected by a mutex and a condition variable
+ * (`-m condvar`), or a counting semaphore (`-m sem`, see `lib/sem.h`). With
+ * `-m both` (the default), both run one after the other.
+ *
+ * `enhanced.c` signals `not_zero` only when the count goes from 0 to 1: with
+ * several consumers waiting, one is woken, the count goes on to 2, 3, ... and
+ * the others keep sleeping. So a consumer may sleep forever once the
+ * producers are done. The condvar version here signals on every increment,
+ * which is correct, but costs a mutex per unit and a system call per wake-up.
+ * With the semaphore, producers post `-b` units at a time with one atomic
+ * add, and consumers take up to `-b` units with one compare-and-swap.
+ *
+ * Each producer makes `-n` units, split evenly among the consumers. The
+ * voluntary context switches of the process (a sleep on a futex is one)
+ * are reported for both versions, and the `futex` calls of the semaphore.
+ *
+ * With `-a policy`, worker `i` (producers first, then consumers) pins itself
+ * with the policy of `lib/placement.h`. The policy and the topology are
+ * printed before the results.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../lib/placement.h"
+#include "../lib/sem.h"
+
+#define MAX_THREADS 256
+
+struct worker {
+    pthread_t tid;
+    int id;              // index, for the placement
+    void *(*fn)(void *); // inc or dec
+    long units; // to make or to take
+    long taken;
+};
+
+static unsigned batch = 16;
+
+/* ------ mutex and condition variable ------ */
+static long count = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t not_zero = PTHREAD_COND_INITIALIZER;
+
+void *inc_condvar(void *arg) {
+    struct worker *w = arg;
+    for (long i = 0; i < w->units; i++) {
+        pthread_mutex_lock(&lock);
+        count++;
+        pthread_cond_signal(&not_zero);
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+void *dec_condvar(void *arg) {
+    struct worker *w = arg;
+    for (long i = 0; i < w->units; i++) {
+        pthread_mutex_lock(&lock);
+        while (count == 0)
+            pthread_cond_wait(&not_zero, &lock);
+        count--;
+        w->taken++;
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+/* ------ semaphore ------ */
+static struct fsem sem = FSEM_INITIALIZER(0);
+
+void *inc_sem(void *arg) {
+    struct worker *w = arg;
+    for (long i = 0; i < w->units; i += batch) {
+        long k = w->units - i < batch ? w->units - i : batch;
+        fsem_post(&sem, k);
+    }
+    return NULL;
+}
+
+void *dec_sem(void *arg) {
+    struct worker *w = arg;
+    while (w->taken < w->units) {
+        long left = w->units - w->taken;
+        w->taken += fsem_wait_many(&sem, left < batch ? left : batch);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Start routine of the workers: pins the thread, then runs its part
+ */
+void *start_worker(void *arg) {
+    struct worker *w = arg;
+    if (placement_apply(w->id) == -1)
+        perror("placement_apply");
+    return w->fn(w);
+}
+
+/**
+ * @brief Current time of the monotonic clock, in seconds
+ */
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Voluntary context switches of the process so far
+ */
+long context_switches() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw;
+}
+
+/**
+ * @brief Runs `producers` threads of `inc` and `consumers` threads of `dec`,
+ * and prints the throughput. Exits on failure
+ *
+ * @return Whether every unit was taken, and none is left
+ */
+int run(const char *name, void *(*inc)(void *), void *(*dec)(void *),
+        int producers, int consumers, long n) {
+    struct worker workers[2 * MAX_THREADS];
+    memset(workers, 0, sizeof(workers));
+    long total = producers * n;
+    long switches = context_switches();
+    unsigned long futex_calls = atomic_load(&sem.sleeps) + atomic_load(&sem.wakes);
+    double start = now();
+    for (int i = 0; i < producers + consumers; i++) {
+        struct worker *w = &workers[i];
+        if (i < producers) {
+            w->units = n;
+        } else {
+            // split evenly, the first ones take the remainder
+            int c = i - producers;
+            w->units = total / consumers + (c < total % consumers);
+        }
+        w->id = i;
+        w->fn = i < producers ? inc : dec;
+        if (pthread_create(&w->tid, NULL, start_worker, w) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    long taken = 0;
+    for (int i = 0; i < producers + consumers; i++) {
+        pthread_join(workers[i].tid, NULL);
+        taken += workers[i].taken;
+    }
+    double elapsed = now() - start;
+    switches = context_switches() - switches;
+
+    int ok, is_sem = inc == inc_sem;
+    char futex_col[32] = "-";
+    if (is_sem) {
+        futex_calls = atomic_load(&sem.sleeps) + atomic_load(&sem.wakes) -
+                      futex_calls;
+        snprintf(futex_col, sizeof(futex_col), "%lu", futex_calls);
+        ok = taken == total && atomic_load(&sem.value) == 0;
+    } else {
+        ok = taken == total && count == 0;
+    }
+    printf("%-8s %9d %9d %6d %10.3f %14.0f %10ld %10s %8s\n", name, producers,
+           consumers, is_sem ? (int)batch : 1, elapsed, total / elapsed,
+           switches, futex_col, ok ? "yes" : "NO");
+    return ok;
+}
+
+void usage(char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-p producers] [-c consumers] [-n units] [-b batch] "
+            "[-m condvar|sem|both] [-a policy]\n"
+            "  -p, -c  threads of each kind, up to %d (default 1 and 8)\n"
+            "  -n      units made by each producer (default 1000000)\n"
+            "  -b      units per post and wait of the semaphore (default 16)\n"
+            "  -a      pin the threads: none (default), compact, scatter or "
+            "node\n",
+            prog, MAX_THREADS);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    int producers = 1, consumers = 8;
+    long n = 1000000;
+    const char *mode = "both";
+    int policy = PLACE_NONE, opt;
+    while ((opt = getopt(argc, argv, "p:c:n:b:m:a:")) != -1) {
+        switch (opt) {
+            case 'p':
+                producers = atoi(optarg);
+                break;
+            case 'c':
+                consumers = atoi(optarg);
+                break;
+            case 'n':
+                n = atol(optarg);
+                break;
+            case 'b':
+                batch = atoi(optarg);
+                break;
+            case 'm':
+                mode = optarg;
+                break;
+            case 'a':
+                if ((policy = placement_parse(optarg)) == -1)
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    int condvar = strcmp(mode, "condvar") == 0 || strcmp(mode, "both") == 0;
+    int semaphore = strcmp(mode, "sem") == 0 || strcmp(mode, "both") == 0;
+    if (producers <= 0 || producers > MAX_THREADS || consumers <= 0 ||
+        consumers > MAX_THREADS || n <= 0 || batch == 0 ||
+        (!condvar && !semaphore))
+        usage(argv[0]);
+
+    // the topology is read even without pinning, to record it
+    if (placement_set(policy) == -1) {
+        fprintf(stderr, "Failed to read the topology. Cause: %s\n",
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+    const struct topology *topo = placement_topology();
+    printf("placement %s: %d cpus, %d cores, %d nodes\n",
+           placement_name(policy), topo->ncpus, topo->ncores, topo->nnodes);
+    printf("%-8s %9s %9s %6s %10s %14s %10s %10s %8s\n", "mode", "producers",
+           "consumers", "batch", "elapsed_s", "units/s", "vol_csw", "futex",
+           "correct");
+    int ok = 1;
+    if (condvar)
+        ok &= run("condvar", inc_condvar, dec_condvar, producers, consumers, n);
+    if (semaphore)
+        ok &= run("sem", inc_sem, dec_sem, producers, consumers, n);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
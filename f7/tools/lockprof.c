@@ -0,0 +1,648 @@
+/**
+ * Lock contention profiler, preloaded into an unmodified program:
+ *
+ *     LD_PRELOAD=bin/liblockprof.so bin/q2-naive
+ *
+ * It interposes `pthread_mutex_lock`, `pthread_mutex_trylock`,
+ * `pthread_mutex_timedlock`, `pthread_mutex_unlock`, `pthread_cond_wait`,
+ * `pthread_cond_timedwait`, `pthread_cond_signal`, `pthread_cond_broadcast`
+ * and `pthread_create`, and records, per lock (or condition variable) and
+ * call site:
+ *  - mutexes: acquisitions, contended ones (the lock was held when asked for),
+ *    and histograms of the time waiting for the lock and of the time it was
+ *    held, in power of 2 buckets of nanoseconds. A failed `trylock`, or a
+ *    `timedlock` that timed out, is not an acquisition and is not recorded
+ *  - condition variables: waits (timed out or not) and the time spent in
+ *    them, and signals that found no thread waiting (lost, if the waiter was
+ *    about to wait)
+ *  - threads: how many were created at each site, and their start routine
+ *
+ * Each thread records into its own table, without any synchronization. The
+ * tables are merged and printed in stderr at exit, sorted by total wait time.
+ *
+ * Overhead: an uncontended lock costs a `trylock` instead of a `lock`, a hash
+ * table update, and two reads of the clock for the hold time. Set
+ * `LOCKPROF_SAMPLE=n` to time the hold of only one acquisition in `n`. The
+ * waits are only timed when contended, when they are long anyway.
+ *
+ * Environment:
+ *  - `LOCKPROF_SAMPLE`: hold time sampling period (default 1, every one)
+ *  - `LOCKPROF_TOP`: number of rows printed (default 20)
+ *  - `LOCKPROF_HIST`: if set, print the histograms of every row
+ *  - `LOCKPROF_OUT`: write the report to `$LOCKPROF_OUT.<pid>` instead of
+ *    stderr. Each process that inherits `LD_PRELOAD` (a wrapper such as
+ *    `timeout`, forked children) reports to its own file. A process that
+ *    recorded no thread does not report at all
+ *
+ * Call sites are printed as `object+offset`, to be given to `addr2line -e
+ * object offset` (build with `-g`), and as `symbol+offset` when `dladdr`
+ * finds the symbol (`-rdynamic` for the functions of the executable).
+ */
+#define _GNU_SOURCE // dlsym, dlvsym, RTLD_NEXT, dladdr
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TABLE_SIZE 1024   // sites per thread, a power of 2
+#define MERGED_SIZE 4096  // sites in the report, a power of 2
+#define COND_SLOTS 1024   // condition variables tracked, a power of 2
+#define MAX_HELD 64       // mutexes held at once by a thread
+#define HIST_BUCKETS 40   // bucket b holds [2^(b-1), 2^b) ns
+
+/** The initial-exec model keeps TLS accesses free of calls into ld.so */
+#define TLS __thread __attribute__((tls_model("initial-exec")))
+
+enum kind {
+    KIND_MUTEX,
+    KIND_COND,
+    KIND_CREATE,
+};
+
+/** Statistics of an object (mutex, condition variable) at a call site */
+struct site {
+    uintptr_t obj; // 0 if the slot is free
+    uintptr_t pc;
+    int kind;
+    uint64_t count;     // acquisitions, waits, or threads created
+    uint64_t contended; // contended acquisitions
+    uint64_t signals;   // signals and broadcasts
+    uint64_t empty;     // signals and broadcasts without any waiter
+    uint64_t wait_ns, max_wait_ns;
+    uint64_t hold_ns, max_hold_ns, holds; // holds: the sampled ones
+    uint32_t wait_hist[HIST_BUCKETS];
+    uint32_t hold_hist[HIST_BUCKETS];
+};
+
+/** A mutex held by a thread */
+struct held {
+    uintptr_t mutex;
+    struct site *site; // where it was acquired
+    uint64_t since;    // 0 if the hold is not sampled
+};
+
+/** Everything a thread records, never freed so that it can be reported */
+struct thread_prof {
+    struct thread_prof *next;
+    struct site table[TABLE_SIZE];
+    struct held held[MAX_HELD];
+    int nheld;
+    unsigned acquisitions; // for sampling
+    uint64_t dropped;      // events lost because the table was full
+};
+
+/** Waiters of a condition variable, shared by every thread */
+struct cond_slot {
+    _Atomic uintptr_t cond;
+    atomic_int waiters;
+};
+
+/* ------ the real functions ------ */
+static int (*real_mutex_lock)(pthread_mutex_t *);
+static int (*real_mutex_trylock)(pthread_mutex_t *);
+static int (*real_mutex_timedlock)(pthread_mutex_t *,
+                                   const struct timespec *);
+static int (*real_mutex_unlock)(pthread_mutex_t *);
+static int (*real_cond_wait)(pthread_cond_t *, pthread_mutex_t *);
+static int (*real_cond_timedwait)(pthread_cond_t *, pthread_mutex_t *,
+                                  const struct timespec *);
+static int (*real_cond_signal)(pthread_cond_t *);
+static int (*real_cond_broadcast)(pthread_cond_t *);
+static int (*real_create)(pthread_t *, const pthread_attr_t *,
+                          void *(*)(void *), void *);
+
+static _Atomic(struct thread_prof *) threads; // every thread's table
+static struct cond_slot conds[COND_SLOTS];
+static unsigned sample_period = 1;
+static TLS struct thread_prof *self;
+static TLS int inside; // set while in the profiler, do not profile it
+
+/**
+ * @brief Looks up a versioned symbol of glibc, or the default one
+ */
+static void *resolve(const char *name, const char *version) {
+    void *fn = dlvsym(RTLD_NEXT, name, version);
+    return fn != NULL ? fn : dlsym(RTLD_NEXT, name);
+}
+
+__attribute__((constructor)) static void init(void) {
+    if (real_mutex_lock != NULL)
+        return;
+    // the condition variables of glibc >= 2.3.2, not the compatibility ones
+    real_cond_wait = resolve("pthread_cond_wait", "GLIBC_2.3.2");
+    real_cond_timedwait = resolve("pthread_cond_timedwait", "GLIBC_2.3.2");
+    real_cond_signal = resolve("pthread_cond_signal", "GLIBC_2.3.2");
+    real_cond_broadcast = resolve("pthread_cond_broadcast", "GLIBC_2.3.2");
+    real_mutex_trylock = dlsym(RTLD_NEXT, "pthread_mutex_trylock");
+    real_mutex_timedlock = dlsym(RTLD_NEXT, "pthread_mutex_timedlock");
+    real_mutex_unlock = dlsym(RTLD_NEXT, "pthread_mutex_unlock");
+    real_create = dlsym(RTLD_NEXT, "pthread_create");
+    real_mutex_lock = dlsym(RTLD_NEXT, "pthread_mutex_lock");
+    const char *s = getenv("LOCKPROF_SAMPLE");
+    if (s != NULL && atoi(s) > 0)
+        sample_period = atoi(s);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int bucket(uint64_t ns) {
+    int b = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    return b < HIST_BUCKETS ? b : HIST_BUCKETS - 1;
+}
+
+/**
+ * @brief The table of the calling thread, created on first use
+ */
+static struct thread_prof *prof(void) {
+    if (self != NULL)
+        return self;
+    // not malloc, which may be the one being profiled
+    struct thread_prof *t = mmap(NULL, sizeof(*t), PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (t == MAP_FAILED)
+        return NULL;
+    t->next = atomic_load(&threads);
+    while (!atomic_compare_exchange_weak(&threads, &t->next, t))
+        ;
+    return self = t;
+}
+
+static uint64_t hash(uintptr_t obj, uintptr_t pc, int kind) {
+    uint64_t h = (obj ^ (pc * 0x9e3779b97f4a7c15ull)) + kind;
+    return h ^ (h >> 29);
+}
+
+/**
+ * @brief The entry of `(obj, pc, kind)` in an open-addressing table of `size`
+ * slots, inserted if missing
+ *
+ * @return The entry, NULL if the table is full
+ */
+static struct site *lookup(struct site *table, size_t size, uintptr_t obj,
+                           uintptr_t pc, int kind) {
+    size_t i = hash(obj, pc, kind) & (size - 1);
+    for (size_t probes = 0; probes < size; probes++, i = (i + 1) & (size - 1)) {
+        struct site *s = &table[i];
+        if (s->obj == 0) {
+            s->obj = obj;
+            s->pc = pc;
+            s->kind = kind;
+            return s;
+        }
+        if (s->obj == obj && s->pc == pc && s->kind == kind)
+            return s;
+    }
+    return NULL;
+}
+
+static struct site *site_of(uintptr_t obj, uintptr_t pc, int kind) {
+    struct thread_prof *t = prof();
+    if (t == NULL)
+        return NULL;
+    struct site *s = lookup(t->table, TABLE_SIZE, obj, pc, kind);
+    if (s == NULL)
+        t->dropped++;
+    return s;
+}
+
+/**
+ * @brief The waiters counter of a condition variable, inserted if missing
+ *
+ * @return The counter, NULL if there is no slot left
+ */
+static atomic_int *cond_waiters(pthread_cond_t *cond) {
+    uintptr_t key = (uintptr_t)cond;
+    size_t i = (key >> 4) & (COND_SLOTS - 1);
+    for (size_t probes = 0; probes < COND_SLOTS;
+         probes++, i = (i + 1) & (COND_SLOTS - 1)) {
+        uintptr_t expected = 0;
+        if (atomic_load_explicit(&conds[i].cond, memory_order_acquire) == key ||
+            atomic_compare_exchange_strong(&conds[i].cond, &expected, key) ||
+            expected == key)
+            return &conds[i].waiters;
+    }
+    return NULL;
+}
+
+static void record_wait(struct site *s, uint64_t ns) {
+    s->wait_ns += ns;
+    if (ns > s->max_wait_ns)
+        s->max_wait_ns = ns;
+    s->wait_hist[bucket(ns)]++;
+}
+
+static void record_hold(struct site *s, uint64_t ns) {
+    s->holds++;
+    s->hold_ns += ns;
+    if (ns > s->max_hold_ns)
+        s->max_hold_ns = ns;
+    s->hold_hist[bucket(ns)]++;
+}
+
+/**
+ * @brief Ends the hold of `mutex` by the calling thread, if it is recorded
+ *
+ * @param keep Whether the mutex stays in the held ones (for a condition wait,
+ * that releases the mutex and takes it back)
+ * @return The hold, NULL if not found
+ */
+static struct held *release(uintptr_t mutex, uint64_t t, int keep) {
+    struct thread_prof *p = self;
+    if (p == NULL)
+        return NULL;
+    // most often the last one taken
+    for (int i = p->nheld - 1; i >= 0; i--) {
+        struct held *h = &p->held[i];
+        if (h->mutex != mutex)
+            continue;
+        if (h->since != 0 && h->site != NULL)
+            record_hold(h->site, t - h->since);
+        if (keep)
+            return h;
+        p->held[i] = p->held[--p->nheld];
+        return h;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Records an acquisition of `mutex` at `pc`, and starts its hold
+ *
+ * @param contended Whether the mutex was held when asked for
+ * @param waited The time waited for it, if contended
+ */
+static void record_acquire(pthread_mutex_t *mutex, uintptr_t pc,
+                           int contended, uint64_t waited) {
+    struct site *s = site_of((uintptr_t)mutex, pc, KIND_MUTEX);
+    if (s != NULL) {
+        s->count++;
+        if (contended) {
+            s->contended++;
+            record_wait(s, waited);
+        }
+    }
+    struct thread_prof *p = self;
+    if (p != NULL && p->nheld < MAX_HELD) {
+        int sampled = p->acquisitions++ % sample_period == 0;
+        p->held[p->nheld++] =
+            (struct held){(uintptr_t)mutex, s, sampled ? now_ns() : 0};
+    }
+}
+
+/**
+ * @brief Takes `mutex` with `trylock` and, if it is held, with `lock` or
+ * `timedlock` (`abstime` not NULL), recording the acquisition at `pc`
+ */
+static int acquire(pthread_mutex_t *mutex, const struct timespec *abstime,
+                   uintptr_t pc) {
+    inside = 1;
+    int ret = real_mutex_trylock(mutex);
+    uint64_t waited = 0;
+    int contended = ret == EBUSY;
+    if (contended) {
+        uint64_t start = now_ns();
+        ret = abstime == NULL ? real_mutex_lock(mutex)
+                              : real_mutex_timedlock(mutex, abstime);
+        waited = now_ns() - start;
+    }
+    if (ret == 0)
+        record_acquire(mutex, pc, contended, waited);
+    inside = 0;
+    return ret;
+}
+
+/* ------ interposed functions ------ */
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+    if (real_mutex_lock == NULL)
+        init();
+    if (inside)
+        return real_mutex_lock(mutex);
+    return acquire(mutex, NULL, (uintptr_t)__builtin_return_address(0));
+}
+
+int pthread_mutex_timedlock(pthread_mutex_t *mutex,
+                            const struct timespec *abstime) {
+    if (real_mutex_timedlock == NULL)
+        init();
+    if (inside)
+        return real_mutex_timedlock(mutex, abstime);
+    return acquire(mutex, abstime, (uintptr_t)__builtin_return_address(0));
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+    if (real_mutex_trylock == NULL)
+        init();
+    int ret = real_mutex_trylock(mutex);
+    if (ret == 0 && !inside) {
+        inside = 1;
+        record_acquire(mutex, (uintptr_t)__builtin_return_address(0), 0, 0);
+        inside = 0;
+    }
+    return ret;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex) {
+    if (real_mutex_unlock == NULL)
+        init();
+    if (!inside && self != NULL && self->nheld > 0) {
+        inside = 1;
+        // read the clock only if the hold is timed
+        struct held *last = &self->held[self->nheld - 1];
+        int timed = last->mutex != (uintptr_t)mutex || last->since != 0;
+        release((uintptr_t)mutex, timed ? now_ns() : 0, 0);
+        inside = 0;
+    }
+    return real_mutex_unlock(mutex);
+}
+
+/**
+ * @brief Waits on `cond`, until `abstime` if not NULL, recording the wait at
+ * `pc` and the waiter for the signals
+ */
+static int cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                     const struct timespec *abstime, uintptr_t pc) {
+    inside = 1;
+    uint64_t start = now_ns();
+    // the mutex is released while waiting, that is not holding it
+    struct held *h = release((uintptr_t)mutex, start, 1);
+    atomic_int *waiters = cond_waiters(cond);
+    if (waiters != NULL)
+        atomic_fetch_add(waiters, 1);
+    inside = 0;
+
+    int ret = abstime == NULL ? real_cond_wait(cond, mutex)
+                              : real_cond_timedwait(cond, mutex, abstime);
+
+    inside = 1;
+    uint64_t end = now_ns();
+    if (waiters != NULL)
+        atomic_fetch_sub(waiters, 1);
+    struct site *s = site_of((uintptr_t)cond, pc, KIND_COND);
+    if (s != NULL) {
+        s->count++;
+        record_wait(s, end - start);
+    }
+    if (h != NULL && h->since != 0)
+        h->since = end;
+    inside = 0;
+    return ret;
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+    if (real_cond_wait == NULL)
+        init();
+    if (inside)
+        return real_cond_wait(cond, mutex);
+    return cond_wait(cond, mutex, NULL,
+                     (uintptr_t)__builtin_return_address(0));
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                           const struct timespec *abstime) {
+    if (real_cond_timedwait == NULL)
+        init();
+    if (inside)
+        return real_cond_timedwait(cond, mutex, abstime);
+    return cond_wait(cond, mutex, abstime,
+                     (uintptr_t)__builtin_return_address(0));
+}
+
+/**
+ * @brief Records a signal or broadcast of `cond` at `pc`
+ */
+static void record_signal(pthread_cond_t *cond, uintptr_t pc) {
+    inside = 1;
+    struct site *s = site_of((uintptr_t)cond, pc, KIND_COND);
+    if (s != NULL) {
+        s->signals++;
+        atomic_int *waiters = cond_waiters(cond);
+        if (waiters != NULL && atomic_load(waiters) == 0)
+            s->empty++;
+    }
+    inside = 0;
+}
+
+int pthread_cond_signal(pthread_cond_t *cond) {
+    if (real_cond_signal == NULL)
+        init();
+    if (!inside)
+        record_signal(cond, (uintptr_t)__builtin_return_address(0));
+    return real_cond_signal(cond);
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond) {
+    if (real_cond_broadcast == NULL)
+        init();
+    if (!inside)
+        record_signal(cond, (uintptr_t)__builtin_return_address(0));
+    return real_cond_broadcast(cond);
+}
+
+int pthread_create(pthread_t *tid, const pthread_attr_t *attr,
+                   void *(*fn)(void *), void *arg) {
+    if (real_create == NULL)
+        init();
+    int ret = real_create(tid, attr, fn, arg);
+    if (ret == 0 && !inside) {
+        inside = 1;
+        struct site *s = site_of((uintptr_t)fn,
+                                 (uintptr_t)__builtin_return_address(0),
+                                 KIND_CREATE);
+        if (s != NULL)
+            s->count++;
+        inside = 0;
+    }
+    return ret;
+}
+
+/* ------ report ------ */
+
+/**
+ * @brief Upper bound of the bucket holding the `p` quantile of a histogram
+ */
+static uint64_t quantile(const uint32_t *hist, uint64_t total, double p) {
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen > 0 && seen >= p * total)
+            return b == 0 ? 0 : 1ull << b;
+    }
+    return 0;
+}
+
+/**
+ * @brief Formats an address as `object+offset (symbol+offset)`
+ */
+static void format_addr(char *buf, size_t len, uintptr_t addr) {
+    Dl_info info;
+    if (dladdr((void *)addr, &info) == 0 || info.dli_fname == NULL) {
+        snprintf(buf, len, "%#lx", (unsigned long)addr);
+        return;
+    }
+    const char *obj = strrchr(info.dli_fname, '/');
+    int n = snprintf(buf, len, "%s+%#lx",
+                     obj != NULL ? obj + 1 : info.dli_fname,
+                     (unsigned long)(addr - (uintptr_t)info.dli_fbase));
+    if (info.dli_sname != NULL && n >= 0 && (size_t)n < len)
+        snprintf(buf + n, len - n, " (%s+%#lx)", info.dli_sname,
+                 (unsigned long)(addr - (uintptr_t)info.dli_saddr));
+}
+
+static void print_addr(FILE *f, uintptr_t addr) {
+    char buf[512];
+    format_addr(buf, sizeof(buf), addr);
+    fputs(buf, f);
+}
+
+static void print_hist(FILE *f, const char *name, const uint32_t *hist) {
+    fprintf(f, "      %s:", name);
+    for (int b = 0; b < HIST_BUCKETS; b++)
+        if (hist[b] > 0)
+            fprintf(f, " <%lluns:%u", b == 0 ? 1ull : 1ull << b, hist[b]);
+    fprintf(f, "\n");
+}
+
+static int by_wait(const void *a, const void *b) {
+    const struct site *x = *(struct site *const *)a;
+    const struct site *y = *(struct site *const *)b;
+    if (x->wait_ns != y->wait_ns)
+        return x->wait_ns < y->wait_ns ? 1 : -1;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+/**
+ * @brief Adds the statistics of `src` to `dst`
+ */
+static void merge(struct site *dst, const struct site *src) {
+    dst->count += src->count;
+    dst->contended += src->contended;
+    dst->signals += src->signals;
+    dst->empty += src->empty;
+    dst->wait_ns += src->wait_ns;
+    dst->hold_ns += src->hold_ns;
+    dst->holds += src->holds;
+    if (src->max_wait_ns > dst->max_wait_ns)
+        dst->max_wait_ns = src->max_wait_ns;
+    if (src->max_hold_ns > dst->max_hold_ns)
+        dst->max_hold_ns = src->max_hold_ns;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        dst->wait_hist[b] += src->wait_hist[b];
+        dst->hold_hist[b] += src->hold_hist[b];
+    }
+}
+
+__attribute__((destructor)) static void report(void) {
+    inside = 1;
+    // statistics of threads still running may be slightly off
+    static struct site merged[MERGED_SIZE];
+    static struct site *rows[MERGED_SIZE];
+    int nthreads = 0, nrows = 0;
+    uint64_t dropped = 0;
+    for (struct thread_prof *t = atomic_load(&threads); t != NULL;
+         t = t->next) {
+        nthreads++;
+        dropped += t->dropped;
+        for (int i = 0; i < TABLE_SIZE; i++) {
+            const struct site *s = &t->table[i];
+            if (s->obj == 0)
+                continue;
+            struct site *m =
+                lookup(merged, MERGED_SIZE, s->obj, s->pc, s->kind);
+            if (m == NULL) {
+                dropped++;
+                continue;
+            }
+            if (m->count == 0 && m->signals == 0 && m->holds == 0)
+                rows[nrows++] = m;
+            merge(m, s);
+        }
+    }
+    // e.g. a wrapper that only runs the profiled program
+    if (nthreads == 0)
+        return;
+    qsort(rows, nrows, sizeof(*rows), by_wait);
+
+    FILE *f = stderr;
+    const char *out = getenv("LOCKPROF_OUT");
+    char path[4096];
+    if (out != NULL) {
+        snprintf(path, sizeof(path), "%s.%d", out, (int)getpid());
+        if ((f = fopen(path, "w")) == NULL)
+            f = stderr;
+    }
+    const char *top_env = getenv("LOCKPROF_TOP");
+    int top = top_env != NULL && atoi(top_env) > 0 ? atoi(top_env) : 20;
+    int hist = getenv("LOCKPROF_HIST") != NULL;
+
+    fprintf(f, "lockprof: %d threads recorded, %d sites", nthreads, nrows);
+    if (dropped > 0)
+        fprintf(f, ", %llu events dropped (tables full)",
+                (unsigned long long)dropped);
+    fprintf(f, "\n%-6s %-14s %10s %10s %6s %10s %9s %9s %9s %9s  %s\n", "kind",
+            "object", "count", "contended", "cont%", "wait_ms", "wait_p50",
+            "wait_p99", "hold_avg", "hold_p99", "site");
+    for (int i = 0; i < nrows && i < top; i++) {
+        const struct site *s = rows[i];
+        if (s->kind == KIND_MUTEX) {
+            fprintf(f, "%-6s %#-14lx %10llu %10llu %6.1f %10.3f %9llu %9llu "
+                       "%9llu %9llu  ",
+                    "mutex", (unsigned long)s->obj,
+                    (unsigned long long)s->count,
+                    (unsigned long long)s->contended,
+                    s->count > 0 ? 100.0 * s->contended / s->count : 0,
+                    s->wait_ns / 1e6,
+                    (unsigned long long)quantile(s->wait_hist, s->contended,
+                                                 0.5),
+                    (unsigned long long)quantile(s->wait_hist, s->contended,
+                                                 0.99),
+                    (unsigned long long)(s->holds > 0 ? s->hold_ns / s->holds
+                                                      : 0),
+                    (unsigned long long)quantile(s->hold_hist, s->holds,
+                                                 0.99));
+        } else if (s->kind == KIND_COND) {
+            // for condition variables: waits, and signals without waiter
+            fprintf(f, "%-6s %#-14lx %10llu %10s %6s %10.3f %9llu %9llu "
+                       "%9s %9s  ",
+                    "cond", (unsigned long)s->obj,
+                    (unsigned long long)s->count, "", "", s->wait_ns / 1e6,
+                    (unsigned long long)quantile(s->wait_hist, s->count, 0.5),
+                    (unsigned long long)quantile(s->wait_hist, s->count, 0.99),
+                    "", "");
+        } else {
+            // for threads: the start routine
+            char start[512];
+            format_addr(start, sizeof(start), s->obj);
+            fprintf(f, "%-6s %-14s %10llu %10s %6s %10s %9s %9s %9s %9s  ",
+                    "thread", start, (unsigned long long)s->count, "", "", "",
+                    "", "", "", "");
+        }
+        print_addr(f, s->pc);
+        if (s->kind == KIND_COND && s->signals > 0)
+            fprintf(f, "  [%llu signals, %llu without waiter]",
+                    (unsigned long long)s->signals,
+                    (unsigned long long)s->empty);
+        fprintf(f, "\n");
+        if (hist && s->kind != KIND_CREATE) {
+            print_hist(f, "wait", s->wait_hist);
+            if (s->kind == KIND_MUTEX)
+                print_hist(f, "hold", s->hold_hist);
+        }
+    }
+    fprintf(f, "(times in ns unless noted, quantiles are power of 2 upper "
+               "bounds)\n");
+    if (f != stderr)
+        fclose(f);
+}